@@ -19,7 +19,13 @@
 #include "bertier_failuredetector.h"
 #include "failuredetector.h"
 #include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_hot.h"
 #include "fd_opt_parser.h"
+#include "fd_cohort.h"
+#include "fd_ping_control.h"
+#include "fd_implicit.h"
+#include "fd_sampling.h"
 #include "../hashtable/hashtable.h"
 #include "interarrival_window.h"
 
@@ -31,13 +37,18 @@
 #define DEF_PHI 4.
 #define DEF_BETA 1.
 #define DEF_GAMMA 0.1
+/* arrivals queued in lazy mode before they are folded regardless */
+#define LAZY_PENDING 8
+
+typedef struct {
+	long now;
+	long last_heard; //before the arrival
+	double mean; //window mean after the arrival
+} pending_arrival_t;
 
 typedef struct {
 	char* id;
-	long timeout;
-	long last_heard;
-	long last_sent;
-	long eta; //interrogation interval
+	fd_hot_t *hot; //what queries read
 
 	long ea; //estimate arrival
 	long delta_p; //moderation param
@@ -48,88 +59,320 @@ typedef struct {
 	double error; //error of the last estimation
 
 	interarrival_window_t *sampling_window;
+	fd_batch_t *batch; //block the record was bulk allocated in, if any
+	fd_cohort_t *cohort;
+	fd_ping_control_t ping_control;
+	fd_implicit_t implicit;
+	long sampler; //heartbeat sampling state
+	int change_points; //window restarts the estimate has followed
+	pending_arrival_t *pending; //arrivals not folded yet, lazy mode only
+	int pending_count;
 
 } monitored_t;
 
 static void destroy_monitored(monitored_t *m) {
-	destroy_window(m->sampling_window);
-	free(m);
+	free(m->pending);
+	if (m->batch) {
+		window_clear(m->sampling_window);
+		batch_release(m->batch);
+	} else {
+		destroy_window(m->sampling_window);
+		free(m);
+	}
 }
 
-void bertier_reg_monitored(bertierfd_t *this, char *id, long now, long timeout) {
-	monitored_t *m;
-	m = calloc(1, sizeof(*m));
+static monitored_t* lookup(bertierfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot ? hot->cold : NULL;
+}
 
-	m->id = id;
-	m->last_heard = now;
-	m->last_sent = now;
-	m->timeout = timeout;
-	m->eta = timeout / 2;
+static int init_monitored(bertierfd_t *this, monitored_t *m, long now, long timeout) {
+	m->hot = hot_alloc(&this->hot, m);
+	if (!m->hot) {
+		return 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+	hot_set_last_sent(&this->hot, m->hot, now);
+	hot_set_to(&this->hot, m->hot, timeout);
+	hot_set_eta(&this->hot, m->hot, timeout / 2);
 	m->delay = timeout / 4;
-	m->sampling_window = init_window();
+	ping_control_init(&m->ping_control, hot_eta(&this->hot, m->hot),
+			this->options.max_detection ? this->options.max_detection : timeout);
 	m->ea = now + timeout;
-
-	fd_hashtable_insert(this->monitoreds, id, m);
+	return 1;
 }
 
-void bertier_set_to(bertierfd_t *this, char *id, long timeout) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->timeout = timeout;
-}
+void bertier_reg_monitored(bertierfd_t *this, char *id, long now, long timeout) {
+	monitored_t *m;
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return;
+	}
 
-long bertier_get_to(bertierfd_t *this, char *id) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->timeout;
+	m->sampling_window = init_window();
+	if (!m->sampling_window) {
+		free(m);
+		return;
+	}
+	window_account(m->sampling_window, &this->budget.window_bytes);
+	window_set_compact(m->sampling_window, this->options.compact);
+	window_detect_changes(m->sampling_window,
+			this->options.change_detection);
+	if (!init_monitored(this, m, now, timeout)) {
+		destroy_monitored(m);
+		return;
+	}
+	m->sampler = sampler_seed(&this->options, id);
+	m->id = fd_hashtable_insert(this->monitoreds, id, m->hot);
 }
 
-static void update_timeout(bertierfd_t *this, monitored_t* m, long now, int failed) {
+static void update_timeout(bertierfd_t *this, monitored_t* m, long now,
+		double mean, int failed) {
 	if (m->sampling_window->size > 0) {
 		m->error = now - m->ea - m->delay;
 		m->delay += (long)round(this->gamma * m->error);
 		m->var += this->gamma * (labs(m->error) - m->var);
 		m->alpha = this->beta * (double)m->delay + this->phi * m->var;
+		if (m->cohort) {
+			cohort_add_estimate(m->cohort, m->delay, m->var);
+		}
 
-		m->ea = now + (long)round(m->sampling_window->mean);
+		m->ea = now + (long)round(mean);
 		long t = m->ea + (long)round(m->alpha);
 
 		if (failed) {
 			m->delta_p += this->moderation_step;
 		}
 
-		m->timeout = t - now + m->delta_p;
+		hot_set_to(&this->hot, m->hot, t - now + m->delta_p);
+	}
+}
+
+/* The estimate recurrences are sequential, each error depending on the
+ * previous estimate, so queued arrivals are folded in order with the state
+ * they arrived in. */
+static void fold_pending(bertierfd_t *this, monitored_t *m) {
+	int i;
+
+	for (i = 0; i < m->pending_count; i++) {
+		pending_arrival_t *p = &m->pending[i];
+		update_timeout(this, m, p->now, p->mean,
+				p->now > p->last_heard + hot_to(&this->hot, m->hot));
+	}
+	m->pending_count = 0;
+	m->hot->dirty = 0;
+}
+
+static long current_timeout(bertierfd_t *this, monitored_t *m);
+
+/* After the window restarted at a change point the margin learnt on the
+ * old link is stale, so it starts over from the new samples' deviation,
+ * measuring the next error from this arrival. */
+static void restart_estimate(bertierfd_t *this, monitored_t *m, long now) {
+	current_timeout(this, m);
+	m->change_points = m->sampling_window->change_points;
+	m->delay = 0;
+	m->var = sqrt(window_var(m->sampling_window));
+	m->ea = now;
+}
+
+/* Folds an arrival into the estimate, or in lazy mode queues it until the
+ * timeout is next read. */
+static void arrival(bertierfd_t *this, monitored_t *m, long now) {
+	pending_arrival_t *p;
+
+	if (m->sampling_window->size == 0) {
+		return;
+	}
+	if (m->change_points != m->sampling_window->change_points) {
+		restart_estimate(this, m, now);
+	}
+	if (this->options.lazy_timeout && !m->pending) {
+		m->pending = malloc(LAZY_PENDING * sizeof(*m->pending));
+	}
+	if (!this->options.lazy_timeout || !m->pending) {
+		update_timeout(this, m, now, m->sampling_window->mean,
+				now > hot_last_heard(&this->hot, m->hot) + hot_to(&this->hot, m->hot));
+		return;
+	}
+
+	if (m->pending_count == LAZY_PENDING) {
+		fold_pending(this, m);
+	}
+	p = &m->pending[m->pending_count++];
+	p->now = now;
+	p->last_heard = hot_last_heard(&this->hot, m->hot);
+	p->mean = m->sampling_window->mean;
+	m->hot->dirty = 1;
+}
+
+static long current_timeout(bertierfd_t *this, monitored_t *m) {
+	if (m->hot->dirty) {
+		fold_pending(this, m);
+	}
+	return hot_to(&this->hot, m->hot);
+}
+
+/* An arrival left out of the estimate still moves the expected arrival
+ * the next sampled one is measured against. */
+static void skipped_arrival(bertierfd_t *this, monitored_t *m, long now) {
+	current_timeout(this, m);
+	m->ea = now + (long)round(m->sampling_window->mean);
+	m->sampling_window->last_ping = now;
+}
+
+void bertier_set_to(bertierfd_t *this, char *id, long timeout) {
+	monitored_t* m = lookup(this, id);
+	current_timeout(this, m);
+	hot_set_to(&this->hot, m->hot, timeout);
+}
+
+/* Reads the cold state only when the timeout is stale. */
+static long hot_timeout(bertierfd_t *this, fd_hot_t *hot) {
+	return hot->dirty ? current_timeout(this, hot->cold) : hot_to(&this->hot, hot);
+}
+
+long bertier_get_to(bertierfd_t *this, char *id) {
+	return hot_timeout(this, hashtable_search(this->monitoreds, id));
+}
+
+void bertier_reg_in_cohort(bertierfd_t *this, char *id, char *group,
+		long now, long timeout) {
+	monitored_t *m;
+
+	bertier_reg_monitored(this, id, now, timeout);
+	m = lookup(this, id);
+	if (!m) {
+		return;
+	}
+	m->cohort = fd_cohort_get(this->cohorts, group);
+
+	if (m->cohort->estimates > 0) {
+		m->delay = (long)round(m->cohort->delay);
+		m->var = m->cohort->delay_var;
+		m->alpha = this->beta * (double)m->delay + this->phi * m->var;
+	}
+	if (m->cohort->samples > 0 && this->options.cohort_weight > 0) {
+		window_seed(m->sampling_window, m->cohort->mean, m->cohort->var,
+				this->options.cohort_weight);
+		m->ea = now + (long)round(m->sampling_window->mean);
+		hot_set_to(&this->hot, m->hot, m->ea + (long)round(m->alpha) - now);
+	}
+}
+
+/* An application response to an application request resets the ping
+ * schedule and may be sampled as a heartbeat. */
+static void implicit_heartbeat(bertierfd_t *this, monitored_t *m, long now) {
+	long interarrival;
+	long sent = implicit_app_received(&m->implicit, now,
+			hot_eta(&this->hot, m->hot), &interarrival);
+
+	if (!sent) {
+		return;
+	}
+	if (sent > hot_last_sent(&this->hot, m->hot)) {
+		hot_set_last_sent(&this->hot, m->hot, sent);
+	}
+	if (interarrival) {
+		add_implicit_ping(m->sampling_window, now, interarrival);
+		arrival(this, m, now);
+	} else {
+		m->sampling_window->last_ping = now;
+	}
+}
+
+static interarrival_window_t* window_of(void *value) {
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	return m->sampling_window;
+}
+
+static void add_pending(char *id, void *value, void *usage) {
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+
+	if (m->pending) {
+		((fd_memory_t*) usage)->records +=
+				LAZY_PENDING * sizeof(pending_arrival_t);
 	}
 }
 
+void bertier_memory_usage(bertierfd_t *this, fd_memory_t *usage) {
+	long count = hashtable_count(this->monitoreds);
+
+	memory_add_table(usage, this->monitoreds);
+	memory_add_table(usage, this->cohorts);
+	usage->records += count * sizeof(monitored_t) + hot_pool_memory(&this->hot)
+			+ hashtable_count(this->cohorts) * sizeof(fd_cohort_t);
+	if (this->options.lazy_timeout) {
+		fd_hashtable_foreach(this->monitoreds, add_pending, usage);
+	}
+	usage->windows += count * sizeof(interarrival_window_t)
+			+ this->budget.window_bytes;
+	memory_total(usage);
+}
+
+static void enforce_budget(bertierfd_t *this) {
+	fd_memory_t usage;
+
+	fd_memory_usage(&this->fdetector, &usage);
+	budget_enforce(&this->budget, &usage, this->monitoreds, window_of);
+}
+
 void bertier_msg_rcv(bertierfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
+	monitored_t* m = lookup(this, id);
+
+	if (type == PING && !sample_arrival(&this->options, &m->sampler,
+			m->sampling_window, now)) {
+		skipped_arrival(this, m, now);
+	} else if (type == PING) {
+		long interarrival = m->sampling_window->last_ping ?
+				now - m->sampling_window->last_ping : 0;
 
-	if (type == PING) {
-		int failed = now > m->last_heard + m->timeout;
+		if (m->cohort && interarrival) {
+			cohort_add_interarrival(m->cohort, interarrival);
+		}
 		add_ping(m->sampling_window, now);
-		update_timeout(this, m, now, failed);
+		arrival(this, m, now);
+		if (this->options.adaptive_ping && interarrival) {
+			hot_set_eta(&this->hot, m->hot, ping_control_update(&m->ping_control,
+					hot_eta(&this->hot, m->hot), interarrival, hot_to(&this->hot, m->hot),
+					m->sampling_window->mean, now));
+		}
+	} else {
+		ping_control_app_received(&m->ping_control, now);
+		if (this->options.implicit_heartbeats) {
+			implicit_heartbeat(this, m, now);
+		}
 	}
 
-	m->last_heard = now;
+	hot_set_last_heard(&this->hot, m->hot, now);
+	if (budget_exceeded(&this->budget, hashtable_count(this->monitoreds))) {
+		enforce_budget(this);
+	}
 }
 
 void bertier_msg_sent(bertierfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->last_sent = now;
+	monitored_t* m = lookup(this, id);
+	if (type == APPLICATION && this->options.implicit_heartbeats) {
+		/* only a response proves the link, see implicit_heartbeat */
+		implicit_app_sent(&m->implicit, now);
+	} else {
+		hot_set_last_sent(&this->hot, m->hot, now);
+	}
 }
 
 int bertier_failed(bertierfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now > m->last_heard + bertier_get_to(this, id);
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now > hot_last_heard(&this->hot, hot) + hot_timeout(this, hot);
 }
 
 long bertier_get_idle(bertierfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now - m->last_heard;
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now - hot_last_heard(&this->hot, hot);
 }
 
-int bertier_time_next_ping(bertierfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->eta - (now - m->last_sent);
+long bertier_time_next_ping(bertierfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_eta(&this->hot, hot) - (now - hot_last_sent(&this->hot, hot));
 }
 
 int bertier_should_ping(bertierfd_t *this, char *id, long now) {
@@ -137,23 +380,193 @@ int bertier_should_ping(bertierfd_t *this, char *id, long now) {
 }
 
 void bertier_release(bertierfd_t *this, char *id) {
-	monitored_t* m = hashtable_remove(this->monitoreds, id);
+	fd_hot_t *hot = hashtable_remove(this->monitoreds, id);
+	monitored_t *m = hot->cold;
+
+	hot_free(&this->hot, hot);
 	destroy_monitored(m);
 }
 
+typedef struct {
+	monitored_t m;
+	interarrival_window_t window;
+} batch_el_t;
+
+void bertier_reg_many(bertierfd_t *this, char **ids, int count, long now, long timeout) {
+	fd_batch_t *batch;
+	batch_el_t *els;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+	hashtable_reserve(this->monitoreds, hashtable_count(this->monitoreds) + count);
+
+	els = batch_alloc(&batch, count, sizeof(*els));
+	if (!els) {
+		for (i = 0; i < count; i++) {
+			bertier_reg_monitored(this, ids[i], now, timeout);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		monitored_t *m = &els[i].m;
+
+		m->sampling_window = &els[i].window;
+		window_init(m->sampling_window);
+		window_account(m->sampling_window, &this->budget.window_bytes);
+		window_set_compact(m->sampling_window, this->options.compact);
+		window_detect_changes(m->sampling_window,
+				this->options.change_detection);
+		m->batch = batch;
+		if (!init_monitored(this, m, now, timeout)) {
+			destroy_monitored(m);
+			continue;
+		}
+		m->sampler = sampler_seed(&this->options, ids[i]);
+		m->id = fd_hashtable_insert(this->monitoreds, ids[i], m->hot);
+	}
+}
+
+void bertier_release_many(bertierfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		bertier_release(this, ids[i]);
+	}
+}
+
 void bertier_set_ping_interval(bertierfd_t *this, char *id, long interval) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->eta = interval;
+	monitored_t* m = lookup(this, id);
+	hot_set_eta(&this->hot, m->hot, interval);
+}
+
+static void flush_monitored(char *id, void *value, void *this) {
+	current_timeout(this, ((fd_hot_t*) value)->cold);
+}
+
+static void export_monitored(char *id, void *value, void *arg) {
+	hot_export_t *export = arg;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	long interarrivals[MAX_SIZE];
+	fd_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	hot_export(export->pool, m->hot, &state);
+	state.ea = m->ea;
+	state.delay = m->delay;
+	state.delta_p = m->delta_p;
+	state.alpha = m->alpha;
+	state.var = m->var;
+	state.error = m->error;
+	state.last_ping = m->sampling_window->last_ping;
+	state.window_size = window_copy(m->sampling_window, interarrivals);
+	state.interarrivals = interarrivals;
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void bertier_export_states(bertierfd_t *this, fd_state_visitor_t *visitor) {
+	hot_export_t export = { &this->hot, visitor };
+
+	if (this->options.lazy_timeout) {
+		fd_hashtable_foreach(this->monitoreds, flush_monitored, this);
+	}
+	fd_hashtable_foreach(this->monitoreds, export_monitored, &export);
+}
+
+void bertier_import_state(bertierfd_t *this, fd_state_t *state) {
+	monitored_t* m = lookup(this, state->id);
+	if (!m) {
+		bertier_reg_monitored(this, state->id, state->last_heard, state->timeout);
+		m = lookup(this, state->id);
+		if (!m) {
+			return;
+		}
+	}
+
+	hot_import(&this->hot, m->hot, state);
+	m->hot->dirty = 0;
+	m->pending_count = 0;
+	m->ea = state->ea;
+	m->delay = state->delay;
+	m->delta_p = state->delta_p;
+	m->alpha = state->alpha;
+	m->var = state->var;
+	m->error = state->error;
+	window_restore(m->sampling_window, state->last_ping,
+			state->interarrivals, state->window_size);
+
+	/* a state exported by another algorithm has no estimates: they start
+	 * over from the window's deviation as after a change point, and the
+	 * next arrival is expected a mean interarrival after the last.
+	 * Without samples the registration defaults apply. */
+	if (!state->ea) {
+		if (m->sampling_window->size > 0) {
+			m->delay = 0;
+			m->var = sqrt(window_var(m->sampling_window));
+			m->ea = state->last_ping + (long)round(m->sampling_window->mean);
+		} else {
+			m->delay = state->timeout / 4;
+			m->var = 0;
+			m->ea = state->last_heard + state->timeout;
+		}
+		m->alpha = this->beta * (double)m->delay + this->phi * m->var;
+		m->error = 0;
+	}
+}
+
+/* The estimates fold each arrival with the parameters of its time, so
+ * only queued arrivals are folded, when leaving lazy mode. */
+static void reconfigure_monitored(char *id, void *value, void *this) {
+	bertierfd_t *fd = this;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+
+	window_set_compact(m->sampling_window, fd->options.compact);
+	window_detect_changes(m->sampling_window,
+			fd->options.change_detection);
+	if (!fd->options.lazy_timeout) {
+		current_timeout(fd, m);
+	}
+}
+
+void bertier_reconfigure(bertierfd_t *this, struct hashtable *params_table) {
+	fd_options_t options = this->options;
+
+	update_fd_options(&options, params_table);
+	this->gamma = parse_double(this->gamma, hashtable_search(params_table, "gamma"));
+	this->beta = parse_double(this->beta, hashtable_search(params_table, "beta"));
+	this->phi = parse_double(this->phi, hashtable_search(params_table, "phi"));
+	this->moderation_step = parse_long(this->moderation_step,
+			hashtable_search(params_table, "moderationstep"));
+	budget_set_limit(&this->budget, options.memory_budget, this->monitoreds,
+			window_of);
+	this->options = options;
+	fd_hashtable_foreach(this->monitoreds, reconfigure_monitored, this);
+}
+
+static void destroy_value(char *id, void *value, void *arg) {
+	destroy_monitored(((fd_hot_t*) value)->cold);
+}
+
+void bertier_destroy(bertierfd_t *this) {
+	fd_hashtable_foreach(this->monitoreds, destroy_value, NULL);
+	hashtable_destroy(this->monitoreds, 0);
+	hashtable_destroy(this->cohorts, 1);
+	hot_pool_destroy(&this->hot);
+	free(this);
 }
 
 bertierfd_t* bertierfd_init_params(double gamma, double beta,
-		double phi, long moderation_step) {
+		double phi, long moderation_step, fd_options_t *options) {
 	bertierfd_t *p_fd;
 	p_fd = calloc(1, sizeof(*p_fd));
 
 	p_fd->fdetector.message_received = (void*)bertier_msg_rcv;
 	p_fd->fdetector.message_sent = (void*)bertier_msg_sent;
 	p_fd->fdetector.register_monitored = (void*)bertier_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)bertier_reg_in_cohort;
 	p_fd->fdetector.set_timeout = (void*)bertier_set_to;
 	p_fd->fdetector.get_timeout = (void*)bertier_get_to;
 	p_fd->fdetector.is_failed = (void*)bertier_failed;
@@ -161,24 +574,42 @@ bertierfd_t* bertierfd_init_params(double gamma, double beta,
 	p_fd->fdetector.get_time_to_next_ping = (void*)bertier_time_next_ping;
 	p_fd->fdetector.should_ping = (void*)bertier_should_ping;
 	p_fd->fdetector.release_monitored = (void*)bertier_release;
+	p_fd->fdetector.register_many = (void*)bertier_reg_many;
+	p_fd->fdetector.release_many = (void*)bertier_release_many;
 	p_fd->fdetector.set_ping_interval = (void*)bertier_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)bertier_export_states;
+	p_fd->fdetector.import_state = (void*)bertier_import_state;
+	p_fd->fdetector.memory_usage = (void*)bertier_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)bertier_reconfigure;
+	p_fd->fdetector.destroy = (void*)bertier_destroy;
 
 	p_fd->monitoreds = create_fd_hashtable();
+	p_fd->cohorts = create_fd_hashtable();
 	p_fd->gamma = gamma;
 	p_fd->beta = beta;
 	p_fd->phi = phi;
 	p_fd->moderation_step = moderation_step;
+	p_fd->options = *options;
+	budget_init(&p_fd->budget, options->memory_budget, sizeof(monitored_t));
+	hot_pool_init(&p_fd->hot, options->compact);
 	return p_fd;
 }
 
 bertierfd_t* bertierfd_init(struct hashtable *params_table) {
+	fd_options_t options;
+
+	parse_fd_options(&options, params_table);
 	return bertierfd_init_params(
 			parse_double(DEF_GAMMA, hashtable_search(params_table, "gamma")),
 			parse_double(DEF_BETA, hashtable_search(params_table, "beta")),
 			parse_double(DEF_PHI, hashtable_search(params_table, "phi")),
-			parse_long(DEF_MOD_STEP, hashtable_search(params_table, "moderationstep")));
+			parse_long(DEF_MOD_STEP, hashtable_search(params_table, "moderationstep")),
+			&options);
 }
 
 bertierfd_t* bertierfd_init_def() {
-	return bertierfd_init_params(DEF_GAMMA, DEF_BETA, DEF_PHI, DEF_MOD_STEP);
+	fd_options_t options;
+
+	default_fd_options(&options);
+	return bertierfd_init_params(DEF_GAMMA, DEF_BETA, DEF_PHI, DEF_MOD_STEP, &options);
 }
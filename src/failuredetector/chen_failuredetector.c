@@ -19,91 +19,351 @@
 #include "chen_failuredetector.h"
 #include "failuredetector.h"
 #include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_hot.h"
 #include "../hashtable/hashtable.h"
 #include "interarrival_window.h"
 #include "fd_opt_parser.h"
+#include "fd_cohort.h"
+#include "fd_ping_control.h"
+#include "fd_implicit.h"
+#include "fd_sampling.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #define DEF_ALPHA 5000l
+#define DEF_MISTAKE_RECURRENCE 0l
+/* ping replies between two QoS reconfigurations */
+#define QOS_PERIOD 32
+/* weight of the newest sample in the QoS running statistics */
+#define QOS_GAIN (1. / 256)
+/* smallest eta tried, as a fraction of the largest feasible one */
+#define QOS_MIN_ETA_FRACTION 100
 
 typedef struct {
 	char* id;
-	long timeout;
-	long last_heard;
-	long last_sent;
-	long eta; //interrogation interval
+	fd_hot_t *hot; //what queries read
 	interarrival_window_t *sampling_window;
+	fd_batch_t *batch; //block the record was bulk allocated in, if any
+	fd_cohort_t *cohort;
+	fd_ping_control_t ping_control;
+	fd_implicit_t implicit;
+	long sampler; //heartbeat sampling state
+
+	long detection; //QoS detection time bound
+	long pings_sent;
+	long pings_received;
+	long qos_samples;
+	double qos_mean; //running interarrival mean
+	double qos_var; //running interarrival variance
+	chen_qos_t qos;
 
 } monitored_t;
 
 static void destroy_monitored(monitored_t *m) {
-	destroy_window(m->sampling_window);
-	free(m);
+	if (m->batch) {
+		window_clear(m->sampling_window);
+		batch_release(m->batch);
+	} else {
+		destroy_window(m->sampling_window);
+		free(m);
+	}
+}
+
+static monitored_t* lookup(chenfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot ? hot->cold : NULL;
+}
+
+static int init_monitored(chenfd_t *this, monitored_t *m, long now, long timeout) {
+	m->hot = hot_alloc(&this->hot, m);
+	if (!m->hot) {
+		return 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+	hot_set_last_sent(&this->hot, m->hot, now);
+	hot_set_to(&this->hot, m->hot, timeout);
+	hot_set_eta(&this->hot, m->hot, timeout / 2);
+	ping_control_init(&m->ping_control, hot_eta(&this->hot, m->hot),
+			this->options.max_detection ? this->options.max_detection : timeout);
+
+	m->detection = this->options.max_detection ? this->options.max_detection : timeout;
+	m->qos.eta = hot_eta(&this->hot, m->hot);
+	m->qos.alpha = this->min_mistake_recurrence ?
+			m->detection - hot_eta(&this->hot, m->hot) : this->alpha;
+	m->qos.feasible = 1;
+	return 1;
 }
 
 void chen_reg_monitored(chenfd_t *this, char *id, long now, long timeout) {
 	monitored_t *m;
 	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return;
+	}
 
-	m->id = id;
-	m->last_heard = now;
-	m->last_sent = now;
-	m->timeout = timeout;
-	m->eta = timeout / 2;
 	m->sampling_window = init_window();
-
-	fd_hashtable_insert(this->monitoreds, id, m);
+	if (!m->sampling_window) {
+		free(m);
+		return;
+	}
+	window_account(m->sampling_window, &this->budget.window_bytes);
+	window_set_compact(m->sampling_window, this->options.compact);
+	window_detect_changes(m->sampling_window,
+			this->options.change_detection);
+	if (!init_monitored(this, m, now, timeout)) {
+		destroy_monitored(m);
+		return;
+	}
+	m->sampler = sampler_seed(&this->options, id);
+	m->id = fd_hashtable_insert(this->monitoreds, id, m->hot);
 }
 
 void chen_set_to(chenfd_t *this, char *id, long timeout) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->timeout = timeout;
-}
-
-long chen_get_to(chenfd_t *this, char *id) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->timeout;
+	monitored_t* m = lookup(this, id);
+	m->hot->dirty = 0;
+	hot_set_to(&this->hot, m->hot, timeout);
 }
 
 static void update_timeout(chenfd_t *this, monitored_t* m, long now) {
 	if (m->sampling_window->size > 0) {
 		double ea = now + m->sampling_window->mean;
-		long t = (long)ea + this->alpha;
-		m->timeout = t - now;
+		long t = (long)ea + m->qos.alpha;
+		hot_set_to(&this->hot, m->hot, t - now);
+	}
+}
+
+/* Recomputes the timeout, or in lazy mode defers it to the next read. */
+static void estimate_changed(chenfd_t *this, monitored_t *m, long now) {
+	if (this->options.lazy_timeout) {
+		m->hot->dirty = 1;
+	} else {
+		update_timeout(this, m, now);
+	}
+}
+
+static long current_timeout(chenfd_t *this, monitored_t *m) {
+	if (m->hot->dirty) {
+		update_timeout(this, m, m->sampling_window->last_ping);
+		m->hot->dirty = 0;
+	}
+	return hot_to(&this->hot, m->hot);
+}
+
+/* Reads the cold state only when the timeout is stale. */
+static long hot_timeout(chenfd_t *this, fd_hot_t *hot) {
+	return hot->dirty ? current_timeout(this, hot->cold) : hot_to(&this->hot, hot);
+}
+
+long chen_get_to(chenfd_t *this, char *id) {
+	return hot_timeout(this, hashtable_search(this->monitoreds, id));
+}
+
+/* log of the lower bound on mistake recurrence time Chen et al. derive for
+ * interrogation interval eta, given loss probability and delay variance */
+static double log_mistake_recurrence(double eta, double detection,
+		double loss, double delay_var) {
+	double log_f = log(eta);
+	int j, n = (int)ceil(detection / eta) - 1;
+
+	for (j = 1; j <= n; j++) {
+		double x = detection - j * eta;
+		double den = delay_var + loss * x * x;
+		if (den <= 0) {
+			return INFINITY;
+		}
+		log_f += log((delay_var + x * x) / den);
+	}
+	return log_f;
+}
+
+/* Picks the largest eta, and the alpha going with it, that meets the QoS
+ * targets under the observed loss probability and delay variance. */
+static void configure_qos(chenfd_t *this, monitored_t *m) {
+	double detection = m->detection;
+	double loss = m->qos.loss_probability;
+	double delay_var = m->qos.delay_var;
+	double duration = this->max_mistake_duration ?
+			this->max_mistake_duration : detection;
+	double log_recurrence = log(this->min_mistake_recurrence);
+	double gamma = (1 - loss) * detection * detection
+			/ (delay_var + detection * detection);
+	double eta_max = fmin(gamma * duration, detection);
+	double eta;
+
+	m->qos.feasible = 0;
+	for (eta = eta_max; eta >= 1 && eta >= eta_max / QOS_MIN_ETA_FRACTION; eta *= 0.9) {
+		if (log_mistake_recurrence(eta, detection, loss, delay_var) >= log_recurrence) {
+			m->qos.feasible = 1;
+			break;
+		}
 	}
+	if (!m->qos.feasible) {
+		/* ping as often as allowed, keeping the detection time bound */
+		eta = fmax(1, eta_max / QOS_MIN_ETA_FRACTION);
+	}
+
+	m->qos.eta = (long)eta;
+	m->qos.alpha = (long)(detection - eta);
+	hot_set_eta(&this->hot, m->hot, m->qos.eta);
+}
+
+static void update_qos(chenfd_t *this, monitored_t *m, long interarrival) {
+	double delta;
+
+	m->pings_received++;
+	if (m->qos_samples < 1. / QOS_GAIN) {
+		m->qos_samples++;
+	}
+	delta = interarrival - m->qos_mean;
+	m->qos_mean += delta / m->qos_samples;
+	m->qos_var += (delta * (interarrival - m->qos_mean) - m->qos_var)
+			/ m->qos_samples;
+
+	if (m->pings_received >= QOS_PERIOD) {
+		double lost = m->pings_sent > m->pings_received ?
+				1 - (double)m->pings_received / m->pings_sent : 0;
+		m->qos.loss_probability += (lost - m->qos.loss_probability)
+				* QOS_PERIOD * QOS_GAIN;
+		/* interarrivals differ by two independent delays */
+		m->qos.delay_var = m->qos_var / 2;
+		m->pings_sent = 0;
+		m->pings_received = 0;
+		configure_qos(this, m);
+	}
+}
+
+void chen_reg_in_cohort(chenfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	monitored_t *m;
+
+	chen_reg_monitored(this, id, now, timeout);
+	m = lookup(this, id);
+	if (!m) {
+		return;
+	}
+	m->cohort = fd_cohort_get(this->cohorts, group);
+
+	if (m->cohort->samples > 0 && this->options.cohort_weight > 0) {
+		window_seed(m->sampling_window, m->cohort->mean, m->cohort->var,
+				this->options.cohort_weight);
+		update_timeout(this, m, now);
+	}
+}
+
+/* An application response to an application request resets the ping
+ * schedule and may be sampled as a heartbeat. */
+static void implicit_heartbeat(chenfd_t *this, monitored_t *m, long now) {
+	long interarrival;
+	long sent = implicit_app_received(&m->implicit, now,
+			hot_eta(&this->hot, m->hot), &interarrival);
+
+	if (!sent) {
+		return;
+	}
+	if (sent > hot_last_sent(&this->hot, m->hot)) {
+		hot_set_last_sent(&this->hot, m->hot, sent);
+	}
+	if (interarrival) {
+		add_implicit_ping(m->sampling_window, now, interarrival);
+		estimate_changed(this, m, now);
+	} else {
+		m->sampling_window->last_ping = now;
+	}
+}
+
+static interarrival_window_t* window_of(void *value) {
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	return m->sampling_window;
+}
+
+void chen_memory_usage(chenfd_t *this, fd_memory_t *usage) {
+	long count = hashtable_count(this->monitoreds);
+
+	memory_add_table(usage, this->monitoreds);
+	memory_add_table(usage, this->cohorts);
+	usage->records += count * sizeof(monitored_t) + hot_pool_memory(&this->hot)
+			+ hashtable_count(this->cohorts) * sizeof(fd_cohort_t);
+	usage->windows += count * sizeof(interarrival_window_t)
+			+ this->budget.window_bytes;
+	memory_total(usage);
+}
+
+static void enforce_budget(chenfd_t *this) {
+	fd_memory_t usage;
+
+	fd_memory_usage(&this->fdetector, &usage);
+	budget_enforce(&this->budget, &usage, this->monitoreds, window_of);
 }
 
 void chen_msg_rcv(chenfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
+	monitored_t* m = lookup(this, id);
 
-	if (type == PING) {
+	if (type == PING && !sample_arrival(&this->options, &m->sampler,
+			m->sampling_window, now)) {
+		if (this->min_mistake_recurrence) {
+			update_qos(this, m, now - m->sampling_window->last_ping);
+		}
+		m->sampling_window->last_ping = now;
+	} else if (type == PING) {
+		long interarrival = m->sampling_window->last_ping ?
+				now - m->sampling_window->last_ping : 0;
+
+		if (m->cohort && interarrival) {
+			cohort_add_interarrival(m->cohort, interarrival);
+		}
 		add_ping(m->sampling_window, now);
-		update_timeout(this, m, now);
+		if (this->min_mistake_recurrence && interarrival) {
+			update_qos(this, m, interarrival);
+		}
+		estimate_changed(this, m, now);
+		if (this->options.adaptive_ping && !this->min_mistake_recurrence
+				&& interarrival) {
+			hot_set_eta(&this->hot, m->hot, ping_control_update(&m->ping_control,
+					hot_eta(&this->hot, m->hot), interarrival, hot_to(&this->hot, m->hot),
+					m->sampling_window->mean, now));
+		}
+	} else {
+		ping_control_app_received(&m->ping_control, now);
+		if (this->options.implicit_heartbeats) {
+			implicit_heartbeat(this, m, now);
+		}
 	}
 
-	m->last_heard = now;
+	hot_set_last_heard(&this->hot, m->hot, now);
+	if (budget_exceeded(&this->budget, hashtable_count(this->monitoreds))) {
+		enforce_budget(this);
+	}
 }
 
 void chen_msg_sent(chenfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->last_sent = now;
+	monitored_t* m = lookup(this, id);
+	if (type == APPLICATION && this->options.implicit_heartbeats) {
+		/* only a response proves the link, see implicit_heartbeat */
+		implicit_app_sent(&m->implicit, now);
+	} else {
+		hot_set_last_sent(&this->hot, m->hot, now);
+	}
+	if (type == PING) {
+		m->pings_sent++;
+	}
 }
 
 int chen_failed(chenfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now > m->last_heard + chen_get_to(this, id);
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now > hot_last_heard(&this->hot, hot) + hot_timeout(this, hot);
 }
 
 long chen_get_idle(chenfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now - m->last_heard;
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now - hot_last_heard(&this->hot, hot);
 }
 
-int chen_time_next_ping(chenfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->eta - (now - m->last_sent);
+long chen_time_next_ping(chenfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_eta(&this->hot, hot) - (now - hot_last_sent(&this->hot, hot));
 }
 
 int chen_should_ping(chenfd_t *this, char *id, long now) {
@@ -111,22 +371,169 @@ int chen_should_ping(chenfd_t *this, char *id, long now) {
 }
 
 void chen_release(chenfd_t *this, char *id) {
-	monitored_t* m = hashtable_remove(this->monitoreds, id);
+	fd_hot_t *hot = hashtable_remove(this->monitoreds, id);
+	monitored_t *m = hot->cold;
+
+	hot_free(&this->hot, hot);
 	destroy_monitored(m);
 }
 
+typedef struct {
+	monitored_t m;
+	interarrival_window_t window;
+} batch_el_t;
+
+void chen_reg_many(chenfd_t *this, char **ids, int count, long now, long timeout) {
+	fd_batch_t *batch;
+	batch_el_t *els;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+	hashtable_reserve(this->monitoreds, hashtable_count(this->monitoreds) + count);
+
+	els = batch_alloc(&batch, count, sizeof(*els));
+	if (!els) {
+		for (i = 0; i < count; i++) {
+			chen_reg_monitored(this, ids[i], now, timeout);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		monitored_t *m = &els[i].m;
+
+		m->sampling_window = &els[i].window;
+		window_init(m->sampling_window);
+		window_account(m->sampling_window, &this->budget.window_bytes);
+		window_set_compact(m->sampling_window, this->options.compact);
+		window_detect_changes(m->sampling_window,
+				this->options.change_detection);
+		m->batch = batch;
+		if (!init_monitored(this, m, now, timeout)) {
+			destroy_monitored(m);
+			continue;
+		}
+		m->sampler = sampler_seed(&this->options, ids[i]);
+		m->id = fd_hashtable_insert(this->monitoreds, ids[i], m->hot);
+	}
+}
+
+void chen_release_many(chenfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		chen_release(this, ids[i]);
+	}
+}
+
 void chen_set_ping_interval(chenfd_t *this, char *id, long interval) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->eta = interval;
+	monitored_t* m = lookup(this, id);
+	hot_set_eta(&this->hot, m->hot, interval);
 }
 
-chenfd_t* chenfd_init_params(long alpha) {
+void chen_get_qos(chenfd_t *this, char *id, chen_qos_t *qos) {
+	monitored_t* m = lookup(this, id);
+	*qos = m->qos;
+	qos->eta = hot_eta(&this->hot, m->hot);
+}
+
+static void flush_monitored(char *id, void *value, void *this) {
+	current_timeout(this, ((fd_hot_t*) value)->cold);
+}
+
+static void export_monitored(char *id, void *value, void *arg) {
+	hot_export_t *export = arg;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	long interarrivals[MAX_SIZE];
+	fd_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	hot_export(export->pool, m->hot, &state);
+	state.last_ping = m->sampling_window->last_ping;
+	state.window_size = window_copy(m->sampling_window, interarrivals);
+	state.interarrivals = interarrivals;
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void chen_export_states(chenfd_t *this, fd_state_visitor_t *visitor) {
+	hot_export_t export = { &this->hot, visitor };
+
+	if (this->options.lazy_timeout) {
+		fd_hashtable_foreach(this->monitoreds, flush_monitored, this);
+	}
+	fd_hashtable_foreach(this->monitoreds, export_monitored, &export);
+}
+
+void chen_import_state(chenfd_t *this, fd_state_t *state) {
+	monitored_t* m = lookup(this, state->id);
+	if (!m) {
+		chen_reg_monitored(this, state->id, state->last_heard, state->timeout);
+		m = lookup(this, state->id);
+		if (!m) {
+			return;
+		}
+	}
+
+	hot_import(&this->hot, m->hot, state);
+	m->hot->dirty = 0;
+	window_restore(m->sampling_window, state->last_ping,
+			state->interarrivals, state->window_size);
+}
+
+/* Recomputes a timeout under the new parameters, from the window. */
+static void reconfigure_monitored(char *id, void *value, void *this) {
+	chenfd_t *fd = this;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+
+	if (!fd->min_mistake_recurrence) {
+		m->qos.alpha = fd->alpha;
+	}
+	window_set_compact(m->sampling_window, fd->options.compact);
+	window_detect_changes(m->sampling_window,
+			fd->options.change_detection);
+	m->hot->dirty = 0;
+	estimate_changed(fd, m, m->sampling_window->last_ping);
+}
+
+void chen_reconfigure(chenfd_t *this, struct hashtable *params_table) {
+	fd_options_t options = this->options;
+
+	update_fd_options(&options, params_table);
+	this->alpha = parse_long(this->alpha, hashtable_search(params_table, "alpha"));
+	this->min_mistake_recurrence = parse_long(this->min_mistake_recurrence,
+			hashtable_search(params_table, "mistakerecurrence"));
+	this->max_mistake_duration = parse_long(this->max_mistake_duration,
+			hashtable_search(params_table, "mistakeduration"));
+	budget_set_limit(&this->budget, options.memory_budget, this->monitoreds,
+			window_of);
+	this->options = options;
+	fd_hashtable_foreach(this->monitoreds, reconfigure_monitored, this);
+}
+
+static void destroy_value(char *id, void *value, void *arg) {
+	destroy_monitored(((fd_hot_t*) value)->cold);
+}
+
+void chen_destroy(chenfd_t *this) {
+	fd_hashtable_foreach(this->monitoreds, destroy_value, NULL);
+	hashtable_destroy(this->monitoreds, 0);
+	hashtable_destroy(this->cohorts, 1);
+	hot_pool_destroy(&this->hot);
+	free(this);
+}
+
+chenfd_t* chenfd_init_params(long alpha, long min_mistake_recurrence,
+		long max_mistake_duration, fd_options_t *options) {
 	chenfd_t *p_fd;
 	p_fd = calloc(1, sizeof(*p_fd));
 
 	p_fd->fdetector.message_received = (void*)chen_msg_rcv;
 	p_fd->fdetector.message_sent = (void*)chen_msg_sent;
 	p_fd->fdetector.register_monitored = (void*)chen_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)chen_reg_in_cohort;
 	p_fd->fdetector.set_timeout = (void*)chen_set_to;
 	p_fd->fdetector.get_timeout = (void*)chen_get_to;
 	p_fd->fdetector.is_failed = (void*)chen_failed;
@@ -134,18 +541,41 @@ chenfd_t* chenfd_init_params(long alpha) {
 	p_fd->fdetector.get_time_to_next_ping = (void*)chen_time_next_ping;
 	p_fd->fdetector.should_ping = (void*)chen_should_ping;
 	p_fd->fdetector.release_monitored = (void*)chen_release;
+	p_fd->fdetector.register_many = (void*)chen_reg_many;
+	p_fd->fdetector.release_many = (void*)chen_release_many;
 	p_fd->fdetector.set_ping_interval = (void*)chen_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)chen_export_states;
+	p_fd->fdetector.import_state = (void*)chen_import_state;
+	p_fd->fdetector.memory_usage = (void*)chen_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)chen_reconfigure;
+	p_fd->fdetector.destroy = (void*)chen_destroy;
 
 	p_fd->monitoreds = create_fd_hashtable();
+	p_fd->cohorts = create_fd_hashtable();
 	p_fd->alpha = alpha;
+	p_fd->min_mistake_recurrence = min_mistake_recurrence;
+	p_fd->max_mistake_duration = max_mistake_duration;
+	p_fd->options = *options;
+	budget_init(&p_fd->budget, options->memory_budget, sizeof(monitored_t));
+	hot_pool_init(&p_fd->hot, options->compact);
 	return p_fd;
 }
 
 chenfd_t* chenfd_init(struct hashtable *params_table) {
+	fd_options_t options;
+
+	parse_fd_options(&options, params_table);
 	return chenfd_init_params(
-			parse_long(DEF_ALPHA, (char*) hashtable_search(params_table, "alpha")));
+			parse_long(DEF_ALPHA, (char*) hashtable_search(params_table, "alpha")),
+			parse_long(DEF_MISTAKE_RECURRENCE,
+					hashtable_search(params_table, "mistakerecurrence")),
+			parse_long(0, hashtable_search(params_table, "mistakeduration")),
+			&options);
 }
 
 chenfd_t* chenfd_init_def() {
-	return chenfd_init_params(DEF_ALPHA);
+	fd_options_t options;
+
+	default_fd_options(&options);
+	return chenfd_init_params(DEF_ALPHA, DEF_MISTAKE_RECURRENCE, 0, &options);
 }
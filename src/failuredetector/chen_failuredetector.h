@@ -19,13 +19,33 @@
 #ifndef CHEN_FAILUREDETECTOR_H_
 #define CHEN_FAILUREDETECTOR_H_
 #include "failuredetector.h"
+#include "fd_opt_parser.h"
+#include "fd_memory.h"
+#include "fd_hot.h"
 
 typedef struct {
 	fdetector_t fdetector;
-	struct hashtable *monitoreds;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
+	struct hashtable *cohorts;
+	fd_options_t options;
+	fd_budget_t budget;
 	long alpha;
+	long min_mistake_recurrence; //QoS target, 0 when not configuring from QoS
+	long max_mistake_duration;
 } chenfd_t;
 
+/* Values chosen for a monitored when configuring from QoS targets. */
+typedef struct {
+	long eta;
+	long alpha;
+	double loss_probability;
+	double delay_var;
+	int feasible; //whether eta and alpha meet every target
+} chen_qos_t;
+
 chenfd_t* chenfd_init(struct hashtable *params_table);
 
+void chen_get_qos(chenfd_t *this, char *id, chen_qos_t *qos);
+
 #endif /* CHEN_FAILUREDETECTOR_H_ */
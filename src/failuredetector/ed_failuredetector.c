@@ -0,0 +1,489 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ed_failuredetector.h"
+#include "failuredetector.h"
+#include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_hot.h"
+#include "../hashtable/hashtable.h"
+#include "interarrival_window.h"
+#include "fd_opt_parser.h"
+#include "fd_cohort.h"
+#include "fd_ping_control.h"
+#include "fd_implicit.h"
+#include "fd_sampling.h"
+#include "fd_accrual.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define DEF_THRESHOLD 0.999
+#define DEF_MIN_WINDOW_SIZE 500
+
+typedef struct {
+	char* id;
+	fd_hot_t *hot; //what queries read
+	interarrival_window_t *sampling_window;
+	fd_batch_t *batch; //block the record was bulk allocated in, if any
+	fd_cohort_t *cohort;
+	fd_ping_control_t ping_control;
+	fd_implicit_t implicit;
+	long sampler; //heartbeat sampling state
+	int seeded; //window holds a cohort prior
+
+} monitored_t;
+
+static void destroy_monitored(monitored_t *m) {
+	if (m->batch) {
+		window_clear(m->sampling_window);
+		batch_release(m->batch);
+	} else {
+		destroy_window(m->sampling_window);
+		free(m);
+	}
+}
+
+static monitored_t* lookup(edfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot ? hot->cold : NULL;
+}
+
+static int init_monitored(edfd_t *this, monitored_t *m, long now, long timeout) {
+	m->hot = hot_alloc(&this->hot, m);
+	if (!m->hot) {
+		return 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+	hot_set_last_sent(&this->hot, m->hot, now);
+	hot_set_to(&this->hot, m->hot, timeout);
+	hot_set_eta(&this->hot, m->hot, timeout / 2);
+	ping_control_init(&m->ping_control, hot_eta(&this->hot, m->hot),
+			this->options.max_detection ? this->options.max_detection : timeout);
+	return 1;
+}
+
+void ed_reg_monitored(edfd_t *this, char *id, long now, long timeout) {
+	monitored_t *m;
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return;
+	}
+
+	m->sampling_window = init_window();
+	if (!m->sampling_window) {
+		free(m);
+		return;
+	}
+	window_account(m->sampling_window, &this->budget.window_bytes);
+	window_set_compact(m->sampling_window, this->options.compact);
+	window_detect_changes(m->sampling_window,
+			this->options.change_detection);
+	if (!init_monitored(this, m, now, timeout)) {
+		destroy_monitored(m);
+		return;
+	}
+	m->sampler = sampler_seed(&this->options, id);
+	m->id = fd_hashtable_insert(this->monitoreds, id, m->hot);
+}
+
+void ed_set_to(edfd_t *this, char *id, long timeout) {
+	monitored_t* m = lookup(this, id);
+	m->hot->dirty = 0;
+	hot_set_to(&this->hot, m->hot, timeout);
+}
+
+
+/* The suspicion level crosses the threshold a fixed number of means after
+ * the last heartbeat, so failures are checked against a timeout. */
+static void update_timeout(edfd_t *this, monitored_t* m, long now) {
+	hot_set_to(&this->hot, m->hot, (long) (this->factor * m->sampling_window->mean));
+}
+
+/* Recomputes the timeout, or in lazy mode defers it to the next read. */
+static void estimate_changed(edfd_t *this, monitored_t *m, long now) {
+	if (this->options.lazy_timeout) {
+		m->hot->dirty = 1;
+	} else {
+		update_timeout(this, m, now);
+	}
+}
+
+static long current_timeout(edfd_t *this, monitored_t *m) {
+	if (m->hot->dirty) {
+		update_timeout(this, m, m->sampling_window->last_ping);
+		m->hot->dirty = 0;
+	}
+	return hot_to(&this->hot, m->hot);
+}
+
+/* Reads the cold state only when the timeout is stale. */
+static long hot_timeout(edfd_t *this, fd_hot_t *hot) {
+	return hot->dirty ? current_timeout(this, hot->cold) : hot_to(&this->hot, hot);
+}
+
+long ed_get_to(edfd_t *this, char *id) {
+	return hot_timeout(this, hashtable_search(this->monitoreds, id));
+}
+
+void ed_reg_in_cohort(edfd_t *this, char *id, char *group,
+		long now, long timeout) {
+	monitored_t *m;
+
+	ed_reg_monitored(this, id, now, timeout);
+	m = lookup(this, id);
+	if (!m) {
+		return;
+	}
+	m->cohort = fd_cohort_get(this->cohorts, group);
+
+	if (m->cohort->samples > 0 && this->options.cohort_weight > 0) {
+		window_seed(m->sampling_window, m->cohort->mean, m->cohort->var,
+				this->options.cohort_weight);
+		m->seeded = 1;
+		update_timeout(this, m, now);
+	}
+}
+
+/* An application response to an application request resets the ping
+ * schedule and may be sampled as a heartbeat. */
+static void implicit_heartbeat(edfd_t *this, monitored_t *m, long now) {
+	long interarrival;
+	long sent = implicit_app_received(&m->implicit, now,
+			hot_eta(&this->hot, m->hot), &interarrival);
+
+	if (!sent) {
+		return;
+	}
+	if (sent > hot_last_sent(&this->hot, m->hot)) {
+		hot_set_last_sent(&this->hot, m->hot, sent);
+	}
+	if (interarrival) {
+		add_implicit_ping(m->sampling_window, now, interarrival);
+		if (m->seeded || m->sampling_window->change_points
+				|| window_holds(m->sampling_window, this->min_window_size)) {
+			estimate_changed(this, m, now);
+		}
+	} else {
+		m->sampling_window->last_ping = now;
+	}
+}
+
+static interarrival_window_t* window_of(void *value) {
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	return m->sampling_window;
+}
+
+void ed_memory_usage(edfd_t *this, fd_memory_t *usage) {
+	long count = hashtable_count(this->monitoreds);
+
+	memory_add_table(usage, this->monitoreds);
+	memory_add_table(usage, this->cohorts);
+	usage->records += count * sizeof(monitored_t) + hot_pool_memory(&this->hot)
+			+ hashtable_count(this->cohorts) * sizeof(fd_cohort_t);
+	usage->windows += count * sizeof(interarrival_window_t)
+			+ this->budget.window_bytes;
+	memory_total(usage);
+}
+
+static void enforce_budget(edfd_t *this) {
+	fd_memory_t usage;
+
+	fd_memory_usage(&this->fdetector, &usage);
+	budget_enforce(&this->budget, &usage, this->monitoreds, window_of);
+}
+
+void ed_msg_rcv(edfd_t *this, char *id, long now, int type) {
+	monitored_t* m = lookup(this, id);
+
+	if (type == PING && !sample_arrival(&this->options, &m->sampler,
+			m->sampling_window, now)) {
+		m->sampling_window->last_ping = now;
+	} else if (type == PING) {
+		long interarrival = m->sampling_window->last_ping ?
+				now - m->sampling_window->last_ping : 0;
+
+		if (m->cohort && interarrival) {
+			cohort_add_interarrival(m->cohort, interarrival);
+		}
+		add_ping(m->sampling_window, now);
+		if (m->seeded || m->sampling_window->change_points
+				|| window_holds(m->sampling_window, this->min_window_size)) {
+			estimate_changed(this, m, now);
+		}
+		if (this->options.adaptive_ping && interarrival) {
+			hot_set_eta(&this->hot, m->hot, ping_control_update(&m->ping_control,
+					hot_eta(&this->hot, m->hot), interarrival, hot_to(&this->hot, m->hot),
+					m->sampling_window->mean, now));
+		}
+	} else {
+		ping_control_app_received(&m->ping_control, now);
+		if (this->options.implicit_heartbeats) {
+			implicit_heartbeat(this, m, now);
+		}
+	}
+
+	hot_set_last_heard(&this->hot, m->hot, now);
+	if (budget_exceeded(&this->budget, hashtable_count(this->monitoreds))) {
+		enforce_budget(this);
+	}
+}
+
+void ed_msg_sent(edfd_t *this, char *id, long now, int type) {
+	monitored_t* m = lookup(this, id);
+	if (type == APPLICATION && this->options.implicit_heartbeats) {
+		/* only a response proves the link, see implicit_heartbeat */
+		implicit_app_sent(&m->implicit, now);
+	} else {
+		hot_set_last_sent(&this->hot, m->hot, now);
+	}
+}
+
+int ed_failed(edfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now > hot_last_heard(&this->hot, hot) + hot_timeout(this, hot);
+}
+
+double ed_suspicion(edfd_t *this, char *id, long now) {
+	monitored_t* m = lookup(this, id);
+	double mean = m->sampling_window->mean;
+
+	if (mean <= 0) {
+		return 0;
+	}
+	return accrual_exp_cdf((now - hot_last_heard(&this->hot, m->hot)) / mean);
+}
+
+long ed_get_idle(edfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now - hot_last_heard(&this->hot, hot);
+}
+
+long ed_time_next_ping(edfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_eta(&this->hot, hot) - (now - hot_last_sent(&this->hot, hot));
+}
+
+int ed_should_ping(edfd_t *this, char *id, long now) {
+	return ed_time_next_ping(this, id, now) <= 0;
+}
+
+void ed_release(edfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_remove(this->monitoreds, id);
+	monitored_t *m = hot->cold;
+
+	hot_free(&this->hot, hot);
+	destroy_monitored(m);
+}
+
+typedef struct {
+	monitored_t m;
+	interarrival_window_t window;
+} batch_el_t;
+
+void ed_reg_many(edfd_t *this, char **ids, int count, long now, long timeout) {
+	fd_batch_t *batch;
+	batch_el_t *els;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+	hashtable_reserve(this->monitoreds, hashtable_count(this->monitoreds) + count);
+
+	els = batch_alloc(&batch, count, sizeof(*els));
+	if (!els) {
+		for (i = 0; i < count; i++) {
+			ed_reg_monitored(this, ids[i], now, timeout);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		monitored_t *m = &els[i].m;
+
+		m->sampling_window = &els[i].window;
+		window_init(m->sampling_window);
+		window_account(m->sampling_window, &this->budget.window_bytes);
+		window_set_compact(m->sampling_window, this->options.compact);
+		window_detect_changes(m->sampling_window,
+				this->options.change_detection);
+		m->batch = batch;
+		if (!init_monitored(this, m, now, timeout)) {
+			destroy_monitored(m);
+			continue;
+		}
+		m->sampler = sampler_seed(&this->options, ids[i]);
+		m->id = fd_hashtable_insert(this->monitoreds, ids[i], m->hot);
+	}
+}
+
+void ed_release_many(edfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		ed_release(this, ids[i]);
+	}
+}
+
+void ed_set_ping_interval(edfd_t *this, char *id, long interval) {
+	monitored_t* m = lookup(this, id);
+	hot_set_eta(&this->hot, m->hot, interval);
+}
+
+static void flush_monitored(char *id, void *value, void *this) {
+	current_timeout(this, ((fd_hot_t*) value)->cold);
+}
+
+static void export_monitored(char *id, void *value, void *arg) {
+	hot_export_t *export = arg;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	long interarrivals[MAX_SIZE];
+	fd_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	hot_export(export->pool, m->hot, &state);
+	state.last_ping = m->sampling_window->last_ping;
+	state.window_size = window_copy(m->sampling_window, interarrivals);
+	state.interarrivals = interarrivals;
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void ed_export_states(edfd_t *this, fd_state_visitor_t *visitor) {
+	hot_export_t export = { &this->hot, visitor };
+
+	if (this->options.lazy_timeout) {
+		fd_hashtable_foreach(this->monitoreds, flush_monitored, this);
+	}
+	fd_hashtable_foreach(this->monitoreds, export_monitored, &export);
+}
+
+void ed_import_state(edfd_t *this, fd_state_t *state) {
+	monitored_t* m = lookup(this, state->id);
+	if (!m) {
+		ed_reg_monitored(this, state->id, state->last_heard, state->timeout);
+		m = lookup(this, state->id);
+		if (!m) {
+			return;
+		}
+	}
+
+	hot_import(&this->hot, m->hot, state);
+	m->hot->dirty = 0;
+	window_restore(m->sampling_window, state->last_ping,
+			state->interarrivals, state->window_size);
+}
+
+/* Recomputes a timeout under the new parameters, from the window. */
+static void reconfigure_monitored(char *id, void *value, void *this) {
+	edfd_t *fd = this;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+
+	window_set_compact(m->sampling_window, fd->options.compact);
+	window_detect_changes(m->sampling_window,
+			fd->options.change_detection);
+	m->hot->dirty = 0;
+	if (m->seeded || m->sampling_window->change_points
+			|| window_holds(m->sampling_window, fd->min_window_size)) {
+		estimate_changed(fd, m, m->sampling_window->last_ping);
+	}
+}
+
+void ed_reconfigure(edfd_t *this, struct hashtable *params_table) {
+	fd_options_t options = this->options;
+
+	update_fd_options(&options, params_table);
+	this->threshold = parse_double(this->threshold,
+			hashtable_search(params_table, "threshold"));
+	this->factor = -log1p(-this->threshold);
+	this->min_window_size = parse_long(this->min_window_size,
+			hashtable_search(params_table, "minwindowsize"));
+	budget_set_limit(&this->budget, options.memory_budget, this->monitoreds,
+			window_of);
+	this->options = options;
+	fd_hashtable_foreach(this->monitoreds, reconfigure_monitored, this);
+}
+
+static void destroy_value(char *id, void *value, void *arg) {
+	destroy_monitored(((fd_hot_t*) value)->cold);
+}
+
+void ed_destroy(edfd_t *this) {
+	fd_hashtable_foreach(this->monitoreds, destroy_value, NULL);
+	hashtable_destroy(this->monitoreds, 0);
+	hashtable_destroy(this->cohorts, 1);
+	hot_pool_destroy(&this->hot);
+	free(this);
+}
+
+edfd_t* edfd_init_params(double threshold, int min_window_size,
+		fd_options_t *options) {
+	edfd_t *p_fd;
+	p_fd = calloc(1, sizeof(*p_fd));
+
+	p_fd->fdetector.message_received = (void*)ed_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)ed_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)ed_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)ed_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)ed_set_to;
+	p_fd->fdetector.get_timeout = (void*)ed_get_to;
+	p_fd->fdetector.is_failed = (void*)ed_failed;
+	p_fd->fdetector.get_idle_time = (void*)ed_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)ed_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)ed_should_ping;
+	p_fd->fdetector.release_monitored = (void*)ed_release;
+	p_fd->fdetector.register_many = (void*)ed_reg_many;
+	p_fd->fdetector.release_many = (void*)ed_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)ed_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)ed_export_states;
+	p_fd->fdetector.import_state = (void*)ed_import_state;
+	p_fd->fdetector.memory_usage = (void*)ed_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)ed_reconfigure;
+	p_fd->fdetector.destroy = (void*)ed_destroy;
+
+	p_fd->monitoreds = create_fd_hashtable();
+	p_fd->cohorts = create_fd_hashtable();
+	p_fd->threshold = threshold;
+	p_fd->factor = -log1p(-threshold);
+	p_fd->min_window_size = min_window_size;
+
+	accrual_init();
+	p_fd->options = *options;
+	budget_init(&p_fd->budget, options->memory_budget, sizeof(monitored_t));
+	hot_pool_init(&p_fd->hot, options->compact);
+	return p_fd;
+}
+
+edfd_t* edfd_init(struct hashtable *params_table) {
+	fd_options_t options;
+
+	parse_fd_options(&options, params_table);
+	return edfd_init_params(
+			parse_double(DEF_THRESHOLD, hashtable_search(params_table, "threshold")),
+			parse_long(DEF_MIN_WINDOW_SIZE, hashtable_search(params_table, "minwindowsize")),
+			&options);
+}
+
+edfd_t* edfd_init_def() {
+	fd_options_t options;
+
+	default_fd_options(&options);
+	return edfd_init_params(DEF_THRESHOLD, DEF_MIN_WINDOW_SIZE, &options);
+}
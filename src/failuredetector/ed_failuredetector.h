@@ -0,0 +1,46 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ED_FAILUREDETECTOR_H_
+#define ED_FAILUREDETECTOR_H_
+#include "failuredetector.h"
+#include "fd_opt_parser.h"
+#include "fd_memory.h"
+#include "fd_hot.h"
+
+/* Exponential distribution accrual detector. */
+
+typedef struct {
+	fdetector_t fdetector;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
+	struct hashtable *cohorts;
+	fd_options_t options;
+	fd_budget_t budget;
+	double threshold; //suspicion level in [0, 1) at which a monitored fails
+	double factor; //timeout in interarrival means, -ln(1 - threshold)
+	int min_window_size;
+} edfd_t;
+
+edfd_t* edfd_init(struct hashtable *params_table);
+
+/* Suspicion level of id at now, the probability under an exponential
+ * interarrival distribution that a heartbeat should have arrived. */
+double ed_suspicion(edfd_t *this, char *id, long now);
+
+#endif /* ED_FAILUREDETECTOR_H_ */
@@ -23,6 +23,45 @@
 #define APPLICATION 0
 #define PING 1
 
+struct hashtable;
+
+/* Detector independent view of a monitored's state, used to persist and
+ * migrate estimators. Fields a detector does not use are left zeroed. */
+typedef struct fd_state {
+	char *id;
+	long timeout;
+	long last_heard;
+	long last_sent;
+	long eta;
+
+	long ea;
+	long delay;
+	long delta_p;
+	double alpha;
+	double var;
+	double error;
+
+	long last_ping;
+	int window_size;
+	long *interarrivals;
+
+	long srtt; //round trip estimate scaled by 8, 0 before the first reply
+	long rttvar; //scaled by 4
+} fd_state_t;
+
+/* Bytes a detector holds, see fd_memory_usage. */
+typedef struct fd_memory {
+	long table; //hash table buckets and entries
+	long records; //per monitored state
+	long windows; //interarrival windows and their samples
+	long keys; //monitored ids
+	long total;
+} fd_memory_t;
+
+typedef struct fd_state_visitor {
+	void (*visit)(struct fd_state_visitor *this, fd_state_t *state);
+} fd_state_visitor_t;
+
 typedef struct fdetector {
 	void (*message_received)(void *this, char *id, long last_recv, int type);
 	void (*message_sent)(void *this, char *id, long last_recv, int type);
@@ -30,11 +69,27 @@ typedef struct fdetector {
 	int (*is_failed)(void *this, char *id, long now);
 	int (*should_ping)(void *this, char *id, long now);
 	void (*register_monitored)(void *this, char *id, long now, long timeout);
+	void (*register_in_cohort)(void *this, char *id, char *group, long now, long timeout);
 	void (*release_monitored)(void *this, char *id);
+	void (*register_many)(void *this, char **ids, int count, long now, long timeout);
+	void (*release_many)(void *this, char **ids, int count);
 	void (*set_ping_interval)(void *this, char *id, long interval);
 	long (*get_idle_time)(void *this, char *id, long now);
 	long (*get_time_to_next_ping)(void *this, char *id, long now);
 	long (*get_timeout)(void *this, char *id);
+	void (*export_states)(void *this, fd_state_visitor_t *visitor);
+	void (*import_state)(void *this, fd_state_t *state);
+	void (*memory_usage)(void *this, fd_memory_t *usage);
+	void (*reconfigure)(void *this, struct hashtable *params_table);
+	void (*destroy)(void *this);
+	/* optional, see fd_tick */
+	void (*tick)(void *this, long now);
+	/* optional, see fd_get_rtt */
+	long (*get_rtt)(void *this, char *id);
+	/* optional, see fd_rank */
+	int (*rank)(void *this, long now, char **best, int k);
+	/* optional, see fd_partitioned */
+	int (*partitioned)(void *this, long now, long *since);
 } fdetector_t;
 
 #endif /* FAILUREDETECTOR_H_ */
@@ -22,9 +22,23 @@
 #include "chen_failuredetector.h"
 #include "bertier_failuredetector.h"
 #include "phiaccrual_failuredetector.h"
+#include "ed_failuredetector.h"
+#include "kappa_failuredetector.h"
+#include "sharded_failuredetector.h"
+#include "tick_failuredetector.h"
+#include "shm_failuredetector.h"
+#include "rtt_failuredetector.h"
+#include "rank_failuredetector.h"
+#include "tune_failuredetector.h"
+#include "partition_failuredetector.h"
 
 #include <string.h>
 
+typedef struct {
+	fd_state_visitor_t visitor;
+	fdetector_t *target;
+} migration_t;
+
 fdetector_t* create_failure_detector(char *fd_name, struct hashtable *params_table) {
 
 	if (strcmp(fd_name, "fixed") == 0) {
@@ -41,5 +55,70 @@ fdetector_t* create_failure_detector(char *fd_name, struct hashtable *params_tab
 		return (fdetector_t*)phiaccrualfd_init(params_table);
 	}
 
+	if (strcmp(fd_name, "ed") == 0) {
+		return (fdetector_t*)edfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "kappa") == 0) {
+		return (fdetector_t*)kappafd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "sharded") == 0) {
+		return (fdetector_t*)shardedfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "tick") == 0) {
+		return (fdetector_t*)tickfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "shm") == 0) {
+		return (fdetector_t*)shmfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "rtt") == 0) {
+		return (fdetector_t*)rttfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "rank") == 0) {
+		return (fdetector_t*)rankfd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "tune") == 0) {
+		return (fdetector_t*)tunefd_init(params_table);
+	}
+
+	if (strcmp(fd_name, "partition") == 0) {
+		return (fdetector_t*)partitionfd_init(params_table);
+	}
+
 	return 0;
 }
+
+void fd_reconfigure(fdetector_t *fd, struct hashtable *params_table) {
+	if (fd->reconfigure) {
+		fd->reconfigure(fd, params_table);
+	}
+}
+
+static void migrate(fd_state_visitor_t *visitor, fd_state_t *state) {
+	fdetector_t *target = ((migration_t*) visitor)->target;
+	target->import_state(target, state);
+}
+
+fdetector_t* fd_switch_algorithm(fdetector_t *fd, char *fd_name,
+		struct hashtable *params_table) {
+	migration_t migration;
+
+	migration.target = create_failure_detector(fd_name, params_table);
+	if (!migration.target) {
+		return NULL;
+	}
+	migration.visitor.visit = migrate;
+	fd->export_states(fd, &migration.visitor);
+	fd_destroy(fd);
+	return migration.target;
+}
+
+void fd_destroy(fdetector_t *fd) {
+	fd->destroy(fd);
+}
@@ -24,4 +24,20 @@
 
 fdetector_t* create_failure_detector(char *fd_name, struct hashtable *params_table);
 
+/* Applies the parameters in params_table to fd and its monitoreds, keeping
+ * every monitored's state. Parameters absent from the table keep their
+ * current values. */
+void fd_reconfigure(fdetector_t *fd, struct hashtable *params_table);
+
+/* Moves every monitored of fd, with its window, last heard and sent times,
+ * timeout and ping interval, to a new detector of the named algorithm, and
+ * destroys fd. Estimator state the old algorithm did not keep is seeded
+ * from the window. Returns the new detector, or NULL leaving fd untouched
+ * if it could not be created. */
+fdetector_t* fd_switch_algorithm(fdetector_t *fd, char *fd_name,
+		struct hashtable *params_table);
+
+/* Releases fd and every monitored it holds. */
+void fd_destroy(fdetector_t *fd);
+
 #endif /* FAILUREDETECTOR_FACTORY_H_ */
@@ -0,0 +1,123 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_accrual.h"
+
+#include <math.h>
+#include <pthread.h>
+
+#define KAPPA_ITERATIONS 60
+
+static double exp_cdf[ACCRUAL_EXP_STEPS + 2];
+static double normal_cdf[ACCRUAL_NORMAL_STEPS + 2];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables() {
+	int i;
+
+	for (i = 0; i <= ACCRUAL_EXP_STEPS + 1; i++) {
+		exp_cdf[i] = -expm1(-i * ACCRUAL_EXP_RANGE / ACCRUAL_EXP_STEPS);
+	}
+	for (i = 0; i <= ACCRUAL_NORMAL_STEPS + 1; i++) {
+		double z = -ACCRUAL_NORMAL_RANGE
+				+ i * 2 * ACCRUAL_NORMAL_RANGE / ACCRUAL_NORMAL_STEPS;
+		normal_cdf[i] = 0.5 * erfc(-z / M_SQRT2);
+	}
+}
+
+void accrual_init() {
+	pthread_once(&tables_once, build_tables);
+}
+
+static double interpolate(double *table, double x) {
+	int i = (int)x;
+	return table[i] + (x - i) * (table[i + 1] - table[i]);
+}
+
+double accrual_exp_cdf(double x) {
+	if (x <= 0) {
+		return 0;
+	}
+	if (x >= ACCRUAL_EXP_RANGE) {
+		return 1;
+	}
+	return interpolate(exp_cdf, x * (ACCRUAL_EXP_STEPS / ACCRUAL_EXP_RANGE));
+}
+
+double accrual_normal_cdf(double z) {
+	if (z <= -ACCRUAL_NORMAL_RANGE) {
+		return 0;
+	}
+	if (z >= ACCRUAL_NORMAL_RANGE) {
+		return 1;
+	}
+	return interpolate(normal_cdf, (z + ACCRUAL_NORMAL_RANGE)
+			* (ACCRUAL_NORMAL_STEPS / (2 * ACCRUAL_NORMAL_RANGE)));
+}
+
+double accrual_kappa(double d, double r) {
+	double kappa = 0;
+	int k;
+
+	if (r <= 0) {
+		/* deterministic arrivals, each missing heartbeat counts in full
+		 * once its expected time has passed */
+		k = (int)d;
+		return d <= 0 ? 0 : d == k ? k - 0.5 : k;
+	}
+	/* heartbeats expected more than the table range ago count in full */
+	k = 1;
+	if (d - ACCRUAL_NORMAL_RANGE * r > 1) {
+		k = (int)(d - ACCRUAL_NORMAL_RANGE * r);
+		kappa = k - 1;
+	}
+	for (; k < d + ACCRUAL_NORMAL_RANGE * r; k++) {
+		kappa += accrual_normal_cdf((d - k) / r);
+	}
+	return kappa;
+}
+
+void accrual_kappa_crossings(double *crossing, double threshold) {
+	int i, j;
+
+	for (i = 0; i <= KAPPA_STEPS; i++) {
+		double r = i * KAPPA_MAX_R / KAPPA_STEPS;
+		double low = 0;
+		double high = threshold + 1 + ACCRUAL_NORMAL_RANGE * r;
+
+		for (j = 0; j < KAPPA_ITERATIONS; j++) {
+			double mid = (low + high) / 2;
+			if (accrual_kappa(mid, r) >= threshold) {
+				high = mid;
+			} else {
+				low = mid;
+			}
+		}
+		crossing[i] = high;
+	}
+}
+
+double accrual_kappa_crossing(double *crossing, double r) {
+	if (r <= 0) {
+		return crossing[0];
+	}
+	if (r >= KAPPA_MAX_R) {
+		return crossing[KAPPA_STEPS];
+	}
+	return interpolate(crossing, r * (KAPPA_STEPS / KAPPA_MAX_R));
+}
@@ -0,0 +1,57 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_ACCRUAL_H_
+#define FD_ACCRUAL_H_
+
+/* Lookup tables for the distributions behind the accrual detectors, so
+ * suspicion levels and timeouts are evaluated with a table lookup and a
+ * linear interpolation instead of libm calls. */
+
+#define ACCRUAL_EXP_RANGE 32.
+#define ACCRUAL_EXP_STEPS 4096
+#define ACCRUAL_NORMAL_RANGE 8.
+#define ACCRUAL_NORMAL_STEPS 4096
+
+/* range of the interarrival standard deviation to mean ratio covered by
+ * the kappa crossing tables */
+#define KAPPA_MAX_R 4.
+#define KAPPA_STEPS 1024
+
+/* Builds the shared tables, once per process. */
+void accrual_init();
+
+/* 1 - e^-x, the exponential distribution's cdf at x means. */
+double accrual_exp_cdf(double x);
+
+/* Standard normal cdf. */
+double accrual_normal_cdf(double z);
+
+/* Kappa of an idle time d expected heartbeats long, with r the ratio of
+ * the interarrival standard deviation to the mean: the sum over the
+ * missing heartbeats of the probability that each should have arrived. */
+double accrual_kappa(double d, double r);
+
+/* Fills crossing with KAPPA_STEPS + 1 normalised idle times at which kappa
+ * reaches threshold, for r evenly spaced over [0, KAPPA_MAX_R]. */
+void accrual_kappa_crossings(double *crossing, double threshold);
+
+/* The crossing for r, interpolated from the table. */
+double accrual_kappa_crossing(double *crossing, double r);
+
+#endif /* FD_ACCRUAL_H_ */
@@ -0,0 +1,53 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* keeps the elements cache line aligned */
+#define HEADER_SIZE ((sizeof(fd_batch_t) + FD_CACHE_LINE - 1) \
+		& ~(size_t)(FD_CACHE_LINE - 1))
+
+void* record_alloc(size_t size) {
+	void *record;
+
+	if (posix_memalign(&record, FD_CACHE_LINE, size)) {
+		return NULL;
+	}
+	return memset(record, 0, size);
+}
+
+void* batch_alloc(fd_batch_t **batch, int count, size_t size) {
+	char *block = record_alloc(HEADER_SIZE + count * size);
+
+	if (!block) {
+		*batch = NULL;
+		return NULL;
+	}
+	*batch = (fd_batch_t*)block;
+	(*batch)->live = count;
+	return block + HEADER_SIZE;
+}
+
+void batch_release(fd_batch_t *batch) {
+	if (--batch->live == 0) {
+		free(batch);
+	}
+}
@@ -0,0 +1,44 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_BATCH_H_
+#define FD_BATCH_H_
+
+#include <stddef.h>
+
+/* Records are aligned to cache lines, so that a query touches a single
+ * line per monitored and records never share one across threads. */
+#define FD_CACHE_LINE 64
+
+/* A block of records allocated together for a bulk registration. The block
+ * is freed once every record in it has been released. */
+typedef struct {
+	long live;
+} fd_batch_t;
+
+/* Allocates a zeroed record aligned to a cache line. Freed with free. */
+void* record_alloc(size_t size);
+
+/* Allocates count zeroed elements of the given size in one block, the
+ * first one aligned to a cache line. */
+void* batch_alloc(fd_batch_t **batch, int count, size_t size);
+
+/* Releases one element of the batch, freeing the block with the last. */
+void batch_release(fd_batch_t *batch);
+
+#endif /* FD_BATCH_H_ */
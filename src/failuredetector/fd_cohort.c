@@ -0,0 +1,52 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_cohort.h"
+#include "fd_hashtable.h"
+#include "../hashtable/hashtable.h"
+
+#include <stdlib.h>
+
+fd_cohort_t* fd_cohort_get(struct hashtable *cohorts, char *group) {
+	fd_cohort_t *cohort = hashtable_search(cohorts, group);
+	if (!cohort) {
+		cohort = calloc(1, sizeof(*cohort));
+		fd_hashtable_insert(cohorts, group, cohort);
+	}
+	return cohort;
+}
+
+void cohort_add_interarrival(fd_cohort_t *cohort, long interarrival) {
+	double delta;
+
+	if (cohort->samples < COHORT_HORIZON) {
+		cohort->samples++;
+	}
+	delta = interarrival - cohort->mean;
+	cohort->mean += delta / cohort->samples;
+	cohort->var += (delta * (interarrival - cohort->mean) - cohort->var)
+			/ cohort->samples;
+}
+
+void cohort_add_estimate(fd_cohort_t *cohort, long delay, double var) {
+	if (cohort->estimates < COHORT_HORIZON) {
+		cohort->estimates++;
+	}
+	cohort->delay += (delay - cohort->delay) / cohort->estimates;
+	cohort->delay_var += (var - cohort->delay_var) / cohort->estimates;
+}
@@ -0,0 +1,48 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_COHORT_H_
+#define FD_COHORT_H_
+
+#include "../hashtable/hashtable.h"
+
+#define DEF_COHORT_WEIGHT 10
+/* number of samples after which cohort averages stop growing their memory
+ * and start to decay exponentially */
+#define COHORT_HORIZON 1000
+
+/* Statistics aggregated over every monitored registered in the same group,
+ * used as a prior for monitoreds that join the group later. */
+typedef struct {
+	long samples;
+	double mean; //interarrival mean
+	double var; //interarrival variance
+
+	long estimates;
+	double delay; //bertier estimate margin
+	double delay_var; //bertier magnitude between errors
+} fd_cohort_t;
+
+/* Returns the cohort named group, creating it on first use. */
+fd_cohort_t* fd_cohort_get(struct hashtable *cohorts, char *group);
+
+void cohort_add_interarrival(fd_cohort_t *cohort, long interarrival);
+
+void cohort_add_estimate(fd_cohort_t *cohort, long delay, double var);
+
+#endif /* FD_COHORT_H_ */
@@ -17,6 +17,7 @@
  */
 
 #include "../hashtable/hashtable.h"
+#include "../hashtable/hashtable_itr.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -34,10 +35,31 @@ static int string_equal(void *key1,void *key2) {
     return strcmp((const char*)key1,(const char*)key2)==0;
 }
 
+unsigned int fd_hashtable_hash(char *key) {
+	return string_hash_djb2(key);
+}
+
 struct hashtable* create_fd_hashtable() {
 	return create_hashtable(32,string_hash_djb2,string_equal);
 }
 
-void fd_hashtable_insert(struct hashtable *hashtable, char *key, void *value) {
-	hashtable_insert(hashtable, strdup(key), value);
+char* fd_hashtable_insert(struct hashtable *hashtable, char *key, void *value) {
+	char *k = strdup(key);
+	hashtable_insert(hashtable, k, value);
+	return k;
+}
+
+void fd_hashtable_foreach(struct hashtable *hashtable,
+		void (*fn)(char *key, void *value, void *arg), void *arg) {
+	struct hashtable_itr *itr;
+
+	if (hashtable_count(hashtable) == 0) {
+		return;
+	}
+
+	itr = hashtable_iterator(hashtable);
+	do {
+		fn(hashtable_iterator_key(itr), hashtable_iterator_value(itr), arg);
+	} while (hashtable_iterator_advance(itr));
+	free(itr);
 }
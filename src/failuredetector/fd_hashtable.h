@@ -23,6 +23,14 @@
 
 struct hashtable* create_fd_hashtable();
 
-void fd_hashtable_insert(struct hashtable *hashtable, char *key, void *value);
+/* The hash used for monitored ids, for callers partitioning them. */
+unsigned int fd_hashtable_hash(char *key);
+
+/* Inserts a copy of key, returning the copy owned by the table. */
+char* fd_hashtable_insert(struct hashtable *hashtable, char *key, void *value);
+
+/* Calls fn for every entry. fn must not insert into or remove from the table. */
+void fd_hashtable_foreach(struct hashtable *hashtable,
+		void (*fn)(char *key, void *value, void *arg), void *arg);
 
 #endif /* FD_HASHTABLE_H_ */
@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_hot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* records per chunk, 16KB of wide records */
+#define HOT_CHUNK 256
+
+/* The records follow the header, at the start of the next cache line. */
+struct hot_chunk {
+	struct hot_chunk *next;
+};
+
+/* Wide records take a cache line, compact ones half of one. */
+static size_t stride(fd_hot_pool_t *pool) {
+	return pool->compact ? FD_CACHE_LINE / 2 : FD_CACHE_LINE;
+}
+
+static fd_hot_t* record(fd_hot_pool_t *pool, struct hot_chunk *chunk, int i) {
+	return (fd_hot_t*)((char*)chunk + FD_CACHE_LINE + i * stride(pool));
+}
+
+static int add_chunk(fd_hot_pool_t *pool) {
+	struct hot_chunk *chunk = record_alloc(FD_CACHE_LINE + HOT_CHUNK * stride(pool));
+	int i;
+
+	if (!chunk) {
+		return 0;
+	}
+	for (i = HOT_CHUNK - 1; i >= 0; i--) {
+		record(pool, chunk, i)->cold = pool->free;
+		record(pool, chunk, i)->released = 1;
+		pool->free = record(pool, chunk, i);
+	}
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->capacity += HOT_CHUNK;
+	return 1;
+}
+
+void hot_pool_init(fd_hot_pool_t *pool, int compact) {
+	pool->compact = compact;
+}
+
+fd_hot_t* hot_alloc(fd_hot_pool_t *pool, void *cold) {
+	fd_hot_t *hot;
+
+	if (!pool->free && !add_chunk(pool)) {
+		return NULL;
+	}
+	hot = pool->free;
+	pool->free = hot->cold;
+	memset(hot, 0, stride(pool));
+	hot->cold = cold;
+	return hot;
+}
+
+void hot_free(fd_hot_pool_t *pool, fd_hot_t *hot) {
+	hot->cold = pool->free;
+	hot->released = 1;
+	pool->free = hot;
+}
+
+void hot_pool_destroy(fd_hot_pool_t *pool) {
+	struct hot_chunk *chunk;
+
+	while ((chunk = pool->chunks)) {
+		pool->chunks = chunk->next;
+		free(chunk);
+	}
+	pool->free = NULL;
+	pool->capacity = 0;
+}
+
+long hot_pool_memory(fd_hot_pool_t *pool) {
+	return pool->capacity / HOT_CHUNK * (FD_CACHE_LINE + HOT_CHUNK * stride(pool));
+}
+
+/* Called about once every INT_MAX time units, so walking every record is
+ * cheap in the long run. */
+void hot_rebase(fd_hot_pool_t *pool, long now) {
+	long shift = now - pool->epoch;
+	struct hot_chunk *chunk;
+	int i;
+
+	for (chunk = pool->chunks; chunk; chunk = chunk->next) {
+		for (i = 0; i < HOT_CHUNK; i++) {
+			fd_hot_t *hot = record(pool, chunk, i);
+
+			if (!hot->released) {
+				hot->t.compact.last_heard = hot_narrow(hot->t.compact.last_heard - shift);
+				hot->t.compact.last_sent = hot_narrow(hot->t.compact.last_sent - shift);
+			}
+		}
+	}
+	pool->epoch = now;
+}
+
+void hot_export(fd_hot_pool_t *pool, fd_hot_t *hot, fd_state_t *state) {
+	state->timeout = hot_to(pool, hot);
+	state->last_heard = hot_last_heard(pool, hot);
+	state->last_sent = hot_last_sent(pool, hot);
+	state->eta = hot_eta(pool, hot);
+}
+
+void hot_import(fd_hot_pool_t *pool, fd_hot_t *hot, fd_state_t *state) {
+	hot_set_to(pool, hot, state->timeout);
+	hot_set_last_heard(pool, hot, state->last_heard);
+	hot_set_last_sent(pool, hot, state->last_sent);
+	hot_set_eta(pool, hot, state->eta);
+}
@@ -0,0 +1,159 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_HOT_H_
+#define FD_HOT_H_
+
+#include <limits.h>
+#include "failuredetector.h"
+#include "fd_batch.h"
+
+/* The part of a monitored's state that queries read. Hot records are
+ * packed in chunks apart from the detector's estimator state, so that
+ * queries over many monitoreds touch a small, dense working set: a cache
+ * line per id, or half of one in compact pools, where the times are kept
+ * in 32 bits relative to the pool's epoch. Times are read and written
+ * through the accessors below. */
+typedef struct fd_hot {
+	void *cold; //the detector's record, next free record once released
+	int dirty; //timeout to be recomputed from the cold state
+	int released;
+	union {
+		struct {
+			long last_heard;
+			long timeout;
+			long last_sent;
+			long eta; //interrogation interval
+		} wide;
+		struct {
+			int last_heard; //relative to the epoch
+			int timeout;
+			int last_sent; //relative to the epoch
+			int eta;
+		} compact;
+	} t;
+} fd_hot_t;
+
+struct hot_chunk;
+
+typedef struct {
+	struct hot_chunk *chunks;
+	fd_hot_t *free;
+	long capacity; //records held by the chunks
+	int compact; //records keep their times in 32 bits
+	long epoch; //time compact records are relative to
+} fd_hot_pool_t;
+
+/* Sets the pool's record layout. Must be called before the first
+ * record is taken. */
+void hot_pool_init(fd_hot_pool_t *pool, int compact);
+
+/* Takes a zeroed hot record pointing to cold. Returns NULL when out of
+ * memory. */
+fd_hot_t* hot_alloc(fd_hot_pool_t *pool, void *cold);
+
+/* Returns a record to the pool. Chunks are kept for later records. */
+void hot_free(fd_hot_pool_t *pool, fd_hot_t *hot);
+
+/* Frees every chunk, and with them every record of the pool. */
+void hot_pool_destroy(fd_hot_pool_t *pool);
+
+/* Bytes held by the pool's chunks. */
+long hot_pool_memory(fd_hot_pool_t *pool);
+
+/* Moves the epoch of a compact pool to now, shifting the times of every
+ * record. Times more than INT_MAX before the new epoch saturate. */
+void hot_rebase(fd_hot_pool_t *pool, long now);
+
+/* Foreach argument of the detectors' state exports. */
+typedef struct {
+	fd_hot_pool_t *pool;
+	fd_state_visitor_t *visitor;
+} hot_export_t;
+
+/* Copies the times of a record to an exported state, and back. */
+void hot_export(fd_hot_pool_t *pool, fd_hot_t *hot, fd_state_t *state);
+void hot_import(fd_hot_pool_t *pool, fd_hot_t *hot, fd_state_t *state);
+
+static inline int hot_narrow(long value) {
+	return value > INT_MAX ? INT_MAX : value < INT_MIN ? INT_MIN : (int)value;
+}
+
+/* Makes time representable in a compact pool, rebasing when it is too far
+ * past the epoch, and returns it relative to the epoch. */
+static inline int hot_relative(fd_hot_pool_t *pool, long time) {
+	if (time - pool->epoch > INT_MAX) {
+		hot_rebase(pool, time);
+	}
+	return hot_narrow(time - pool->epoch);
+}
+
+static inline long hot_last_heard(const fd_hot_pool_t *pool, const fd_hot_t *hot) {
+	return pool->compact ? pool->epoch + hot->t.compact.last_heard
+			: hot->t.wide.last_heard;
+}
+
+static inline void hot_set_last_heard(fd_hot_pool_t *pool, fd_hot_t *hot,
+		long time) {
+	if (pool->compact) {
+		hot->t.compact.last_heard = hot_relative(pool, time);
+	} else {
+		hot->t.wide.last_heard = time;
+	}
+}
+
+static inline long hot_last_sent(const fd_hot_pool_t *pool, const fd_hot_t *hot) {
+	return pool->compact ? pool->epoch + hot->t.compact.last_sent
+			: hot->t.wide.last_sent;
+}
+
+static inline void hot_set_last_sent(fd_hot_pool_t *pool, fd_hot_t *hot,
+		long time) {
+	if (pool->compact) {
+		hot->t.compact.last_sent = hot_relative(pool, time);
+	} else {
+		hot->t.wide.last_sent = time;
+	}
+}
+
+/* Durations saturate at INT_MAX in compact pools. */
+static inline long hot_to(const fd_hot_pool_t *pool, const fd_hot_t *hot) {
+	return pool->compact ? hot->t.compact.timeout : hot->t.wide.timeout;
+}
+
+static inline void hot_set_to(fd_hot_pool_t *pool, fd_hot_t *hot, long timeout) {
+	if (pool->compact) {
+		hot->t.compact.timeout = hot_narrow(timeout);
+	} else {
+		hot->t.wide.timeout = timeout;
+	}
+}
+
+static inline long hot_eta(const fd_hot_pool_t *pool, const fd_hot_t *hot) {
+	return pool->compact ? hot->t.compact.eta : hot->t.wide.eta;
+}
+
+static inline void hot_set_eta(fd_hot_pool_t *pool, fd_hot_t *hot, long eta) {
+	if (pool->compact) {
+		hot->t.compact.eta = hot_narrow(eta);
+	} else {
+		hot->t.wide.eta = eta;
+	}
+}
+
+#endif /* FD_HOT_H_ */
@@ -0,0 +1,50 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_implicit.h"
+
+void implicit_app_sent(fd_implicit_t *implicit, long now) {
+	if (!implicit->app_sent) {
+		implicit->app_sent = now;
+	}
+}
+
+long implicit_app_received(fd_implicit_t *implicit, long now, long eta,
+		long *interarrival) {
+	long sent = implicit->app_sent;
+	long rtt;
+
+	*interarrival = 0;
+	if (!sent) {
+		return 0;
+	}
+	implicit->app_sent = 0;
+
+	rtt = now - sent;
+	if (implicit->last_sample && now - implicit->last_sample >= eta) {
+		*interarrival = eta + rtt - implicit->last_rtt;
+		if (*interarrival <= 0) {
+			*interarrival = 1;
+		}
+	}
+	if (!implicit->last_sample || *interarrival) {
+		implicit->last_rtt = rtt;
+		implicit->last_sample = now;
+	}
+	return sent;
+}
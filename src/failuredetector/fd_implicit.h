@@ -0,0 +1,44 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_IMPLICIT_H_
+#define FD_IMPLICIT_H_
+
+/* Tracks application request/response pairs so they can stand in for
+ * pings when implicit heartbeats are enabled. */
+typedef struct {
+	long app_sent; //oldest unanswered application message, 0 if none
+	long last_rtt;
+	long last_sample;
+} fd_implicit_t;
+
+void implicit_app_sent(fd_implicit_t *implicit, long now);
+
+/* Called on an application arrival. Returns the send time of the request
+ * it answers, or 0 when there was none. *interarrival is set to the
+ * sample the estimator should take, or 0 when no sample is due.
+ *
+ * Application responses arrive at the application's pace rather than every
+ * eta, so their raw interarrivals would bias the estimate towards gaps the
+ * detector never sees once traffic stops. Instead, at most once per eta,
+ * the sample is what a ping reply would have measured: eta plus the change
+ * in round trip time between consecutive pairs. */
+long implicit_app_received(fd_implicit_t *implicit, long now, long eta,
+		long *interarrival);
+
+#endif /* FD_IMPLICIT_H_ */
@@ -0,0 +1,163 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_memory.h"
+#include "fd_hashtable.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* enforcing the budget brings usage this fraction of it below the limit,
+ * so that windows growing back do not trigger it again right away */
+#define BUDGET_SLACK 10
+
+typedef struct {
+	interarrival_window_t *window;
+	double cv; //squared coefficient of variation of the interarrivals
+} ranked_window_t;
+
+typedef struct {
+	ranked_window_t *windows;
+	int count;
+	interarrival_window_t* (*window_of)(void *value);
+} ranking_t;
+
+void fd_memory_usage(fdetector_t *fd, fd_memory_t *usage) {
+	memset(usage, 0, sizeof(*usage));
+	if (fd->memory_usage) {
+		fd->memory_usage(fd, usage);
+	}
+}
+
+static void add_key(char *key, void *value, void *arg) {
+	((fd_memory_t*) arg)->keys += strlen(key) + 1;
+}
+
+void memory_add_table(fd_memory_t *usage, struct hashtable *table) {
+	usage->table += hashtable_memory(table);
+	fd_hashtable_foreach(table, add_key, usage);
+}
+
+void memory_total(fd_memory_t *usage) {
+	usage->total = usage->table + usage->records + usage->windows
+			+ usage->keys;
+}
+
+void budget_init(fd_budget_t *budget, long limit, long record_size) {
+	budget->limit = limit;
+	budget->next_check = limit;
+	budget->window_bytes = 0;
+	budget->per_monitored = record_size + sizeof(interarrival_window_t);
+}
+
+static long estimate(fd_budget_t *budget, long count) {
+	return budget->window_bytes + budget->per_monitored * count;
+}
+
+int budget_exceeded(fd_budget_t *budget, long count) {
+	return budget->limit && estimate(budget, count) > budget->next_check;
+}
+
+typedef struct {
+	interarrival_window_t* (*window_of)(void *value);
+} unlimit_t;
+
+static void unlimit(char *key, void *value, void *arg) {
+	window_set_limit(((unlimit_t*) arg)->window_of(value), 0);
+}
+
+void budget_set_limit(fd_budget_t *budget, long limit,
+		struct hashtable *monitoreds,
+		interarrival_window_t* (*window_of)(void *value)) {
+	unlimit_t arg = { window_of };
+
+	if (budget->limit && (!limit || limit > budget->limit)) {
+		fd_hashtable_foreach(monitoreds, unlimit, &arg);
+	}
+	budget->limit = limit;
+	budget->next_check = limit;
+}
+
+static void rank(char *key, void *value, void *arg) {
+	ranking_t *ranking = arg;
+	ranked_window_t *ranked = ranking->windows + ranking->count++;
+	interarrival_window_t *window = ranking->window_of(value);
+
+	ranked->window = window;
+	/* windows too young to tell are kept for last */
+	if (window->size < WINDOW_MIN_LIMIT || window->mean <= 0) {
+		ranked->cv = HUGE_VAL;
+	} else {
+		ranked->cv = window_var(window) / (window->mean * window->mean);
+	}
+}
+
+static int by_stability(const void *a, const void *b) {
+	double x = ((const ranked_window_t*) a)->cv;
+	double y = ((const ranked_window_t*) b)->cv;
+
+	return x < y ? -1 : x > y;
+}
+
+void budget_enforce(fd_budget_t *budget, fd_memory_t *usage,
+		struct hashtable *monitoreds,
+		interarrival_window_t* (*window_of)(void *value)) {
+	long count = hashtable_count(monitoreds);
+	long excess = usage->total - (budget->limit - budget->limit / BUDGET_SLACK);
+	ranking_t ranking = { NULL, 0, window_of };
+	int i, shrunk;
+
+	if (count) {
+		budget->per_monitored = (usage->total - budget->window_bytes) / count;
+	}
+	budget->next_check = budget->limit;
+	if (usage->total <= budget->limit) {
+		return;
+	}
+
+	ranking.windows = malloc(count * sizeof(ranked_window_t));
+	if (!ranking.windows) {
+		return;
+	}
+	fd_hashtable_foreach(monitoreds, rank, &ranking);
+	qsort(ranking.windows, ranking.count, sizeof(ranked_window_t),
+			by_stability);
+
+	/* halve the windows, most stable first, a pass at a time so that
+	 * no window is cut twice while others are untouched */
+	do {
+		shrunk = 0;
+		for (i = 0; i < ranking.count && excess > 0; i++) {
+			interarrival_window_t *window = ranking.windows[i].window;
+			long before = budget->window_bytes;
+
+			if (window_limit(window) > WINDOW_MIN_LIMIT) {
+				window_set_limit(window, window_limit(window) / 2);
+				excess -= before - budget->window_bytes;
+				shrunk = 1;
+			}
+		}
+	} while (excess > 0 && shrunk);
+	free(ranking.windows);
+
+	/* the budget cannot be met, check again only once usage grew */
+	if (excess > 0) {
+		budget->next_check = estimate(budget, count)
+				+ budget->limit / BUDGET_SLACK;
+	}
+}
@@ -0,0 +1,68 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_MEMORY_H_
+#define FD_MEMORY_H_
+
+#include "failuredetector.h"
+#include "interarrival_window.h"
+#include "../hashtable/hashtable.h"
+
+/* Fills usage with the bytes fd holds, allocator overhead aside. Detectors
+ * that do not account their memory report zeros. */
+void fd_memory_usage(fdetector_t *fd, fd_memory_t *usage);
+
+/* Adds the table, its entries and its string keys to usage. */
+void memory_add_table(fd_memory_t *usage, struct hashtable *table);
+
+/* Sums usage's parts into its total. */
+void memory_total(fd_memory_t *usage);
+
+/*
+ * A budget bounds the memory of a window detector. Windows account their
+ * buffers in window_bytes, so that the detector can tell cheaply when it
+ * may be over budget; it then measures its usage and calls budget_enforce.
+ */
+typedef struct {
+	long limit; //bytes, 0 for no bound
+	long next_check; //estimated usage above which the budget is checked
+	long window_bytes; //interarrival buffers, kept up to date by the windows
+	long per_monitored; //everything else, per monitored, at the last check
+} fd_budget_t;
+
+/* record_size is the detector's per monitored record, used to estimate
+ * usage until it is first measured. */
+void budget_init(fd_budget_t *budget, long limit, long record_size);
+
+/* Whether a detector with count monitoreds may be over budget. */
+int budget_exceeded(fd_budget_t *budget, long count);
+
+/* Changes the budget's limit. Windows shrunk under the previous limit are
+ * allowed to grow again when the limit is raised or lifted. */
+void budget_set_limit(fd_budget_t *budget, long limit,
+		struct hashtable *monitoreds,
+		interarrival_window_t* (*window_of)(void *value));
+
+/* Shrinks the windows of the table's monitoreds, the most stable ones
+ * first, until usage fits the budget with some slack. window_of returns
+ * the window of a table value. */
+void budget_enforce(fd_budget_t *budget, fd_memory_t *usage,
+		struct hashtable *monitoreds,
+		interarrival_window_t* (*window_of)(void *value));
+
+#endif /* FD_MEMORY_H_ */
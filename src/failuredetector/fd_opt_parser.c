@@ -17,7 +17,11 @@
  */
 
 #include "fd_opt_parser.h"
+#include "fd_cohort.h"
+#include "fd_sampling.h"
+#include "../hashtable/hashtable.h"
 #include <stdlib.h>
+#include <string.h>
 
 double parse_double(double def_value, char *prop_value) {
 	if (prop_value) {
@@ -40,3 +44,62 @@ long parse_long(long def_value, char *prop_value) {
 	return def_value;
 }
 
+static int parse_sampling(int def_value, char *prop_value) {
+	if (!prop_value) {
+		return def_value;
+	}
+	if (!strcmp(prop_value, "every")) {
+		return SAMPLE_EVERY;
+	}
+	if (!strcmp(prop_value, "time")) {
+		return SAMPLE_TIME;
+	}
+	if (!strcmp(prop_value, "random")) {
+		return SAMPLE_RANDOM;
+	}
+	return SAMPLE_ALL;
+}
+
+void default_fd_options(fd_options_t *options) {
+	options->cohort_weight = DEF_COHORT_WEIGHT;
+	options->adaptive_ping = 0;
+	options->max_detection = 0;
+	options->implicit_heartbeats = 0;
+	options->lazy_timeout = 0;
+	options->memory_budget = 0;
+	options->compact = 0;
+	options->sampling = SAMPLE_ALL;
+	options->sampling_rate = 1;
+	options->change_detection = 0;
+}
+
+void parse_fd_options(fd_options_t *options, struct hashtable *params_table) {
+	default_fd_options(options);
+	update_fd_options(options, params_table);
+}
+
+void update_fd_options(fd_options_t *options, struct hashtable *params_table) {
+	options->cohort_weight = parse_int(options->cohort_weight,
+			hashtable_search(params_table, "cohortweight"));
+	options->adaptive_ping = parse_int(options->adaptive_ping,
+			hashtable_search(params_table, "adaptiveping"));
+	options->max_detection = parse_long(options->max_detection,
+			hashtable_search(params_table, "maxdetection"));
+	options->implicit_heartbeats = parse_int(options->implicit_heartbeats,
+			hashtable_search(params_table, "implicitheartbeats"));
+	options->lazy_timeout = parse_int(options->lazy_timeout,
+			hashtable_search(params_table, "lazytimeout"));
+	options->memory_budget = parse_long(options->memory_budget,
+			hashtable_search(params_table, "memorybudget"));
+	options->compact = parse_int(options->compact,
+			hashtable_search(params_table, "compact"));
+	options->sampling = parse_sampling(options->sampling,
+			hashtable_search(params_table, "sampling"));
+	options->sampling_rate = parse_long(options->sampling_rate,
+			hashtable_search(params_table, "samplingrate"));
+	if (options->sampling_rate < 1) {
+		options->sampling_rate = 1;
+	}
+	options->change_detection = parse_int(options->change_detection,
+			hashtable_search(params_table, "changedetection"));
+}
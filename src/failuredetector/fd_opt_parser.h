@@ -19,10 +19,33 @@
 #ifndef FD_OPT_PARSER_H_
 #define FD_OPT_PARSER_H_
 
+#include "../hashtable/hashtable.h"
+
+/* Options shared by the adaptive detectors (chen, bertier, phiaccrual). */
+typedef struct {
+	int cohort_weight; //pseudo samples a cohort prior is worth
+	int adaptive_ping; //let the detector tune eta per monitored
+	long max_detection; //detection time bound, 0 for the registration timeout
+	int implicit_heartbeats; //application request/response pairs act as pings
+	int lazy_timeout; //recompute timeouts when read rather than per heartbeat
+	long memory_budget; //bytes the detector may hold, 0 for no bound
+	int compact; //32 bit window samples, and hot times relative to an epoch
+	int sampling; //heartbeats updating the estimate, see fd_sampling.h
+	long sampling_rate; //k for every k-th and random, ms for time sampling
+	int change_detection; //restart windows when the interarrivals shift
+} fd_options_t;
+
 double parse_double(double def_value, char *prop_value);
 
 int parse_int(int def_value, char *prop_value);
 
 long parse_long(long def_value, char *prop_value);
 
+void default_fd_options(fd_options_t *options);
+
+void parse_fd_options(fd_options_t *options, struct hashtable *params_table);
+
+/* Overrides the options present in params_table, keeping the others. */
+void update_fd_options(fd_options_t *options, struct hashtable *params_table);
+
 #endif /* FD_OPT_PARSER_H_ */
@@ -0,0 +1,183 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_perf.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *names[PERF_COUNTERS] = {
+	"cycles", "instr", "L1D-miss", "LLC-miss", "br-miss"
+};
+
+static long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000l + ts.tv_nsec;
+}
+
+#ifdef __linux__
+
+static void counter_attr(int counter, struct perf_event_attr *attr) {
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = PERF_TYPE_HARDWARE;
+	switch (counter) {
+	case PERF_CYCLES:
+		attr->config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PERF_INSTRUCTIONS:
+		attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case PERF_L1D_MISSES:
+		attr->type = PERF_TYPE_HW_CACHE;
+		attr->config = PERF_COUNT_HW_CACHE_L1D
+				| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case PERF_LLC_MISSES:
+		attr->config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	case PERF_BRANCH_MISSES:
+		attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	}
+	attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+			| PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr->exclude_kernel = 1;
+	attr->exclude_hv = 1;
+}
+
+int perf_open(fd_perf_t *perf) {
+	struct perf_event_attr attr;
+	int first_errno = 0;
+	int i;
+
+	perf->leader = -1;
+	perf->opened = 0;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		int fd;
+
+		perf->fds[i] = -1;
+		counter_attr(i, &attr);
+		attr.disabled = perf->leader == -1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, perf->leader, 0);
+		if (fd < 0) {
+			if (!first_errno) {
+				first_errno = errno;
+			}
+			continue;
+		}
+		if (perf->leader == -1) {
+			perf->leader = fd;
+		}
+		perf->fds[i] = fd;
+		perf->slots[i] = perf->opened++;
+	}
+	if (!perf->opened) {
+		errno = first_errno;
+	}
+	return perf->opened;
+}
+
+void perf_start(fd_perf_t *perf, fd_perf_sample_t *sample) {
+	if (perf->opened) {
+		ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+	sample->ns = now_ns();
+}
+
+void perf_stop(fd_perf_t *perf, fd_perf_sample_t *sample) {
+	unsigned long long buf[3 + PERF_COUNTERS];
+	double scale = 1;
+	int i;
+
+	if (perf->opened) {
+		ioctl(perf->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	}
+	sample->ns = now_ns() - sample->ns;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		sample->values[i] = -1;
+	}
+	if (!perf->opened) {
+		return;
+	}
+
+	if (read(perf->leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(buf[0]))
+			|| buf[2] == 0) {
+		return;
+	}
+	/* the group was multiplexed with other events for part of the run */
+	if (buf[2] < buf[1]) {
+		scale = (double)buf[1] / buf[2];
+	}
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] >= 0) {
+			sample->values[i] = buf[3 + perf->slots[i]] * scale;
+		}
+	}
+}
+
+void perf_close(fd_perf_t *perf) {
+	int i;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] >= 0) {
+			close(perf->fds[i]);
+		}
+	}
+	perf->opened = 0;
+}
+
+#else
+
+int perf_open(fd_perf_t *perf) {
+	perf->opened = 0;
+	errno = ENOSYS;
+	return 0;
+}
+
+void perf_start(fd_perf_t *perf, fd_perf_sample_t *sample) {
+	sample->ns = now_ns();
+}
+
+void perf_stop(fd_perf_t *perf, fd_perf_sample_t *sample) {
+	int i;
+
+	sample->ns = now_ns() - sample->ns;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		sample->values[i] = -1;
+	}
+}
+
+void perf_close(fd_perf_t *perf) {
+}
+
+#endif
+
+const char* perf_counter_name(int counter) {
+	return names[counter];
+}
@@ -0,0 +1,57 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_PERF_H_
+#define FD_PERF_H_
+
+/* Hardware counters read around benchmarked detector operations. */
+enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTERS
+};
+
+typedef struct {
+	int leader;
+	int fds[PERF_COUNTERS]; //-1 for counters that could not be opened
+	int slots[PERF_COUNTERS]; //position of each counter in a group read
+	int opened;
+} fd_perf_t;
+
+typedef struct {
+	long ns;
+	double values[PERF_COUNTERS]; //scaled for multiplexing, -1 if unavailable
+} fd_perf_sample_t;
+
+/* Opens the counters for the calling thread. Returns how many could be
+ * opened; with none, errno tells why and samples only carry time. */
+int perf_open(fd_perf_t *perf);
+
+/* Starts the clock and the counters for sample. */
+void perf_start(fd_perf_t *perf, fd_perf_sample_t *sample);
+
+void perf_stop(fd_perf_t *perf, fd_perf_sample_t *sample);
+
+void perf_close(fd_perf_t *perf);
+
+const char* perf_counter_name(int counter);
+
+#endif /* FD_PERF_H_ */
@@ -0,0 +1,71 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_ping_control.h"
+
+#include <stdlib.h>
+
+void ping_control_init(fd_ping_control_t *control, long eta, long bound) {
+	control->min_eta = eta / 4 > 0 ? eta / 4 : 1;
+	control->bound = bound;
+	/* no evidence yet either way */
+	control->jitter = eta * STABLE_JITTER;
+	control->last_app = 0;
+}
+
+void ping_control_app_received(fd_ping_control_t *control, long now) {
+	control->last_app = now;
+}
+
+long ping_control_update(fd_ping_control_t *control, long eta,
+		long interarrival, long timeout, double mean, long now) {
+	long old_eta = eta;
+	double relative;
+	long max_eta;
+	int app_flowing;
+
+	if (eta <= 0) {
+		return eta;
+	}
+
+	control->jitter += JITTER_GAIN * (labs(interarrival - eta) - control->jitter);
+	relative = control->jitter / eta;
+	app_flowing = control->last_app && now - control->last_app < eta;
+
+	if (relative > UNSTABLE_JITTER) {
+		eta /= 2;
+	} else if (relative < STABLE_JITTER || app_flowing) {
+		eta += eta / 8 > 0 ? eta / 8 : 1;
+	}
+
+	if (eta > old_eta && timeout > 0 && mean > 0) {
+		/* the timeout follows the interarrivals, so it grows with eta, and
+		 * the next reply must still arrive before the current timeout */
+		max_eta = (long)(mean * control->bound / timeout);
+		if (max_eta > timeout - 4 * control->jitter) {
+			max_eta = timeout - 4 * control->jitter;
+		}
+		if (eta > max_eta) {
+			eta = max_eta > old_eta ? max_eta : old_eta;
+		}
+	}
+	if (eta < control->min_eta) {
+		eta = control->min_eta;
+	}
+	return eta;
+}
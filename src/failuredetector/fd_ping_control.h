@@ -0,0 +1,50 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_PING_CONTROL_H_
+#define FD_PING_CONTROL_H_
+
+/* jitter, relative to eta, below which the link is considered stable */
+#define STABLE_JITTER 0.1
+/* jitter, relative to eta, above which pings are sent more often */
+#define UNSTABLE_JITTER 0.25
+/* weight of the newest sample in the jitter average */
+#define JITTER_GAIN 0.125
+
+/* Per monitored state of the adaptive ping interval controller. */
+typedef struct {
+	long min_eta;
+	long bound; //detection time the timeout must stay within
+	double jitter; //average deviation of ping interarrivals from eta
+	long last_app; //last application message received
+} fd_ping_control_t;
+
+void ping_control_init(fd_ping_control_t *control, long eta, long bound);
+
+void ping_control_app_received(fd_ping_control_t *control, long now);
+
+/* Folds in the interarrival of a ping reply, given the detector's current
+ * timeout and mean interarrival, and returns the eta to use
+ * from now on. Eta grows slowly while replies arrive on schedule or
+ * application traffic shows the link alive, and halves when jitter grows.
+ * Eta is never grown past the current timeout, nor so far that the timeout,
+ * scaled with the interarrivals, would exceed the bound. */
+long ping_control_update(fd_ping_control_t *control, long eta,
+		long interarrival, long timeout, double mean, long now);
+
+#endif /* FD_PING_CONTROL_H_ */
@@ -0,0 +1,251 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_ping_scheduler.h"
+#include "fd_hashtable.h"
+#include "../hashtable/hashtable.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+typedef struct ping_member {
+	char *id; //owned by the members table
+	struct ping_destination *destination;
+	int index; //in the destination's members
+} ping_member_t;
+
+struct ping_destination {
+	char *tag; //owned by the tags table
+	ping_member_t **members;
+	int count;
+	int capacity;
+	int index; //in the scheduler's destinations
+	long collected; //time of its last collection, LONG_MIN after a member joins
+};
+
+/* Grows *array to hold at least needed elements of size bytes. */
+static int reserve(void **array, int *capacity, int needed, size_t size) {
+	int grown = *capacity ? *capacity : 4;
+	void *resized;
+
+	if (needed <= *capacity) {
+		return 1;
+	}
+	while (grown < needed) {
+		grown *= 2;
+	}
+	resized = realloc(*array, grown * size);
+	if (!resized) {
+		return 0;
+	}
+	*array = resized;
+	*capacity = grown;
+	return 1;
+}
+
+/* Start of the slot holding time. */
+static long align(fd_ping_scheduler_t *scheduler, long time) {
+	long slot = scheduler->slot;
+	return slot > 0 ? time - ((time % slot) + slot) % slot : time;
+}
+
+fd_ping_scheduler_t* ping_scheduler_init(fdetector_t *fd, long slot,
+		long jitter) {
+	fd_ping_scheduler_t *scheduler = calloc(1, sizeof(*scheduler));
+
+	scheduler->fd = fd;
+	scheduler->slot = slot;
+	scheduler->jitter = jitter;
+	scheduler->members = create_fd_hashtable();
+	scheduler->tags = create_fd_hashtable();
+	return scheduler;
+}
+
+static struct ping_destination* get_destination(fd_ping_scheduler_t *scheduler,
+		char *tag) {
+	struct ping_destination *d = hashtable_search(scheduler->tags, tag);
+	int capacity = scheduler->destinations_capacity;
+
+	if (d) {
+		return d;
+	}
+	if (!reserve((void**)&scheduler->destinations, &capacity,
+			scheduler->destinations_count + 1, sizeof(*scheduler->destinations))
+			|| !reserve((void**)&scheduler->batches,
+			&scheduler->destinations_capacity, capacity,
+			sizeof(*scheduler->batches))) {
+		return NULL;
+	}
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		return NULL;
+	}
+	d->tag = fd_hashtable_insert(scheduler->tags, tag, d);
+	d->index = scheduler->destinations_count++;
+	scheduler->destinations[d->index] = d;
+	return d;
+}
+
+static void remove_destination(fd_ping_scheduler_t *scheduler,
+		struct ping_destination *d) {
+	struct ping_destination *last =
+			scheduler->destinations[--scheduler->destinations_count];
+
+	last->index = d->index;
+	scheduler->destinations[d->index] = last;
+	hashtable_remove(scheduler->tags, d->tag);
+	free(d->members);
+	free(d);
+}
+
+int ping_scheduler_add(fd_ping_scheduler_t *scheduler, char *id,
+		char *destination) {
+	struct ping_destination *d;
+	ping_member_t *m;
+
+	ping_scheduler_remove(scheduler, id);
+	if (!reserve((void**)&scheduler->ids, &scheduler->ids_capacity,
+			hashtable_count(scheduler->members) + 1, sizeof(*scheduler->ids))
+			|| !(d = get_destination(scheduler, destination))) {
+		return 0;
+	}
+	if (!reserve((void**)&d->members, &d->capacity, d->count + 1,
+			sizeof(*d->members)) || !(m = malloc(sizeof(*m)))) {
+		if (!d->count) {
+			remove_destination(scheduler, d);
+		}
+		return 0;
+	}
+	m->destination = d;
+	m->index = d->count++;
+	m->id = fd_hashtable_insert(scheduler->members, id, m);
+	d->members[m->index] = m;
+	/* the new member may be due already */
+	d->collected = LONG_MIN;
+	return 1;
+}
+
+void ping_scheduler_remove(fd_ping_scheduler_t *scheduler, char *id) {
+	ping_member_t *m = hashtable_remove(scheduler->members, id);
+	struct ping_destination *d;
+
+	if (!m) {
+		return;
+	}
+	d = m->destination;
+	d->members[m->index] = d->members[--d->count];
+	d->members[m->index]->index = m->index;
+	if (!d->count) {
+		remove_destination(scheduler, d);
+	}
+	free(m);
+}
+
+/* Time the destination's earliest ping is due. */
+static long earliest(fdetector_t *fd, struct ping_destination *d, long now) {
+	long next = LONG_MAX;
+	int i;
+
+	for (i = 0; i < d->count; i++) {
+		long t = fd->get_time_to_next_ping(fd, d->members[i]->id, now);
+		if (t < next) {
+			next = t;
+		}
+	}
+	return now + next;
+}
+
+/* A destination still due after its collection has pings the detector
+ * declines for now, it is looked at again at the next slot. Times to the
+ * next ping are relative to now, so any now gives the same due time. */
+static long next_due(fd_ping_scheduler_t *scheduler,
+		struct ping_destination *d) {
+	long due = align(scheduler, earliest(scheduler->fd, d, 0));
+
+	if (due > d->collected) {
+		return due;
+	}
+	return scheduler->slot > 0 ? align(scheduler, d->collected) + scheduler->slot
+			: d->collected + 1;
+}
+
+int collect_due_pings(fd_ping_scheduler_t *scheduler, long now,
+		fd_ping_batch_t **batches) {
+	fdetector_t *fd = scheduler->fd;
+	long slot_end = align(scheduler, now) + (scheduler->slot > 0 ?
+			scheduler->slot - 1 : 0);
+	long horizon = now + scheduler->jitter > slot_end ?
+			now + scheduler->jitter : slot_end;
+	int count = 0, used = 0;
+	int i, j;
+
+	for (i = 0; i < scheduler->destinations_count; i++) {
+		struct ping_destination *d = scheduler->destinations[i];
+		fd_ping_batch_t *batch = &scheduler->batches[count];
+
+		d->collected = now;
+		if (earliest(fd, d, now) > slot_end) {
+			continue;
+		}
+		batch->ids = scheduler->ids + used;
+		batch->count = 0;
+		for (j = 0; j < d->count; j++) {
+			if (fd->should_ping(fd, d->members[j]->id, horizon)) {
+				batch->ids[batch->count++] = d->members[j]->id;
+			}
+		}
+		for (j = 0; j < batch->count; j++) {
+			fd->message_sent(fd, batch->ids[j], now, PING);
+		}
+		if (batch->count) {
+			batch->destination = d->tag;
+			used += batch->count;
+			count++;
+		}
+	}
+	*batches = scheduler->batches;
+	return count;
+}
+
+long ping_scheduler_next(fd_ping_scheduler_t *scheduler) {
+	long next = LONG_MAX;
+	int i;
+
+	for (i = 0; i < scheduler->destinations_count; i++) {
+		long due = next_due(scheduler, scheduler->destinations[i]);
+		if (due < next) {
+			next = due;
+		}
+	}
+	return next;
+}
+
+void ping_scheduler_destroy(fd_ping_scheduler_t *scheduler) {
+	int i;
+
+	for (i = 0; i < scheduler->destinations_count; i++) {
+		free(scheduler->destinations[i]->members);
+		free(scheduler->destinations[i]);
+	}
+	hashtable_destroy(scheduler->members, 1);
+	hashtable_destroy(scheduler->tags, 0);
+	free(scheduler->destinations);
+	free(scheduler->batches);
+	free(scheduler->ids);
+	free(scheduler);
+}
@@ -0,0 +1,80 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_PING_SCHEDULER_H_
+#define FD_PING_SCHEDULER_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+/* Pings due to one destination, to be sent together. */
+typedef struct {
+	char *destination;
+	char **ids;
+	int count;
+} fd_ping_batch_t;
+
+struct ping_destination;
+
+/* Schedules the pings of a detector's monitoreds by destination, the
+ * connection or server their pings travel on, in place of asking
+ * should_ping per monitored. Pings due anywhere within a slot are all
+ * collected at its start, and once a destination has a ping due, its
+ * monitoreds due within jitter are collected along with it. Pings are
+ * only ever brought forward, so no interval exceeds its eta. Due times
+ * are read from the detector on every call rather than cached, as an eta
+ * may shorten on any message or set_ping_interval. */
+typedef struct {
+	fdetector_t *fd;
+	long slot; //0 for no alignment
+	long jitter; //how early a ping may go out with its destination's batch
+	struct hashtable *members; //ids to their ping_member
+	struct hashtable *tags; //destination tags to their ping_destination
+	struct ping_destination **destinations;
+	int destinations_count;
+	int destinations_capacity;
+
+	/* returned by collect_due_pings */
+	fd_ping_batch_t *batches;
+	char **ids;
+	int ids_capacity;
+} fd_ping_scheduler_t;
+
+fd_ping_scheduler_t* ping_scheduler_init(fdetector_t *fd, long slot,
+		long jitter);
+
+/* Schedules the pings of id, registered in the scheduler's detector, with
+ * the other monitoreds of destination. Returns 0 when out of memory. */
+int ping_scheduler_add(fd_ping_scheduler_t *scheduler, char *id,
+		char *destination);
+
+void ping_scheduler_remove(fd_ping_scheduler_t *scheduler, char *id);
+
+/* Collects the pings due at now, one batch per destination, and records
+ * them in the detector as sent at now. batches is set to an array of the
+ * returned count of batches, valid until the next call. Only monitoreds
+ * the detector's should_ping accepts are collected. */
+int collect_due_pings(fd_ping_scheduler_t *scheduler, long now,
+		fd_ping_batch_t **batches);
+
+/* Time of the next collect_due_pings call that can return a ping. */
+long ping_scheduler_next(fd_ping_scheduler_t *scheduler);
+
+void ping_scheduler_destroy(fd_ping_scheduler_t *scheduler);
+
+#endif /* FD_PING_SCHEDULER_H_ */
@@ -0,0 +1,79 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_SAMPLING_H_
+#define FD_SAMPLING_H_
+
+#include "fd_hashtable.h"
+#include "fd_opt_parser.h"
+#include "interarrival_window.h"
+
+/* Heartbeat subsampling for monitoreds heartbeating faster than their
+ * interarrival distribution changes. Every arrival is heard, but only the
+ * sampled ones update the window and the estimator; the others just move
+ * the window's last ping, so each sample is still the interarrival ending
+ * at its own arrival. */
+enum {
+	SAMPLE_ALL,
+	SAMPLE_EVERY, //every k-th arrival
+	SAMPLE_TIME, //an interarrival starting at least rate ms after the last sample
+	SAMPLE_RANDOM //each arrival with probability 1/k
+};
+
+/* Random sampling starts each monitored's generator from its id, so that
+ * monitoreds registered together do not sample the same arrivals. */
+static inline long sampler_seed(fd_options_t *options, char *id) {
+	return options->sampling == SAMPLE_RANDOM ? (long)fd_hashtable_hash(id) : 0;
+}
+
+/* Whether the arrival at now updates the estimate. sampler is the
+ * monitored's sampling state, set from sampler_seed at registration.
+ * Windows are filled with every arrival before sampling starts, so the
+ * estimate warms up at the full rate. */
+static inline int sample_arrival(fd_options_t *options, long *sampler,
+		interarrival_window_t *window, long now) {
+	unsigned long state;
+
+	if (options->sampling == SAMPLE_ALL || !window->last_ping
+			|| window->size < (window->limit ? window->limit : MAX_SIZE)) {
+		return 1;
+	}
+	switch (options->sampling) {
+	case SAMPLE_EVERY:
+		if (++*sampler < options->sampling_rate) {
+			return 0;
+		}
+		*sampler = 0;
+		return 1;
+	case SAMPLE_TIME:
+		/* deciding on the interarrival's start rather than on its end
+		 * keeps longer interarrivals from being favoured */
+		if (window->last_ping < *sampler + options->sampling_rate) {
+			return 0;
+		}
+		*sampler = now;
+		return 1;
+	case SAMPLE_RANDOM:
+		state = (unsigned long)*sampler * 6364136223846793005ul + 1442695040888963407ul;
+		*sampler = (long)state;
+		return (state >> 33) % options->sampling_rate == 0;
+	}
+	return 1;
+}
+
+#endif /* FD_SAMPLING_H_ */
@@ -0,0 +1,524 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_simulator.h"
+#include "fd_opt_parser.h"
+#include "tick_failuredetector.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_ID_LEN 16
+
+/* At equal times arrivals go first, so a heartbeat landing on a deadline
+ * still counts. */
+enum { SIM_ARRIVE, SIM_CRASH, SIM_CHECK, SIM_TICK };
+
+static const char *delay_models[] = { "constant", "normal", "gamma", "pareto" };
+
+typedef struct {
+	long time;
+	int node; //-1 for ticks
+	int type;
+	int next; //in its wheel list or the free list, -1 ends it
+} sim_event_t;
+
+typedef struct {
+	long crash_at; //LONG_MAX for monitoreds that stay up
+	long sent; //last heartbeat drawn
+	long heard; //last heartbeat delivered
+	long deadline; //when the detector should suspect it, as of deadline_heard
+	long deadline_heard;
+	long suspected_at; //start of a wrong suspicion, -1 if none
+	int checking; //a check is queued
+	int burst; //in a loss burst
+	int done; //crashed and detected
+} sim_node_t;
+
+typedef struct {
+	fdetector_t *fd;
+	fd_sim_config_t *config;
+	fd_sim_result_t *result;
+	sim_node_t *nodes;
+	char *ids;
+	/* The clock advances a millisecond at a time over a wheel of slots,
+	 * each with two lists of events: arrivals and crashes, then the
+	 * others. Events further than the wheel spans wait in a heap. */
+	long now;
+	long wheel; //slots, a power of two
+	int *slots;
+	sim_event_t *events;
+	int events_count;
+	int events_capacity;
+	int free; //first free event
+	sim_event_t *heap;
+	long count;
+	long capacity;
+	unsigned long long rng;
+	long recheck; //delay before asking again a detector that disagreed
+} sim_t;
+
+void default_sim_config(fd_sim_config_t *config) {
+	config->monitoreds = 10000;
+	config->duration = 3600000;
+	config->interval = 1000;
+	config->timeout = 5000;
+	config->delay_model = SIM_GAMMA;
+	config->delay = 20;
+	config->delay_sd = 5;
+	config->gamma_shape = 4;
+	config->pareto_alpha = 2.5;
+	config->loss = 0.001;
+	config->burst_enter = 0;
+	config->burst_exit = 0.5;
+	config->gc_rate = 0;
+	config->gc_pause = 2000;
+	config->crashes = 0.01;
+	config->tick_step = 100;
+	config->seed = 1;
+}
+
+void parse_sim_config(fd_sim_config_t *config, struct hashtable *params_table) {
+	char *model = hashtable_search(params_table, "delaymodel");
+	int i;
+
+	config->monitoreds = parse_int(config->monitoreds,
+			hashtable_search(params_table, "monitoreds"));
+	config->duration = parse_long(config->duration,
+			hashtable_search(params_table, "duration"));
+	config->interval = parse_long(config->interval,
+			hashtable_search(params_table, "interval"));
+	config->timeout = parse_long(config->timeout,
+			hashtable_search(params_table, "timeout"));
+	for (i = 0; model && i < (int)(sizeof(delay_models) / sizeof(*delay_models)); i++) {
+		if (!strcmp(model, delay_models[i])) {
+			config->delay_model = i;
+		}
+	}
+	config->delay = parse_double(config->delay,
+			hashtable_search(params_table, "delay"));
+	config->delay_sd = parse_double(config->delay_sd,
+			hashtable_search(params_table, "delaysd"));
+	config->gamma_shape = parse_double(config->gamma_shape,
+			hashtable_search(params_table, "gammashape"));
+	config->pareto_alpha = parse_double(config->pareto_alpha,
+			hashtable_search(params_table, "paretoalpha"));
+	config->loss = parse_double(config->loss, hashtable_search(params_table, "loss"));
+	config->burst_enter = parse_double(config->burst_enter,
+			hashtable_search(params_table, "burstenter"));
+	config->burst_exit = parse_double(config->burst_exit,
+			hashtable_search(params_table, "burstexit"));
+	config->gc_rate = parse_double(config->gc_rate,
+			hashtable_search(params_table, "gcrate"));
+	config->gc_pause = parse_long(config->gc_pause,
+			hashtable_search(params_table, "gcpause"));
+	config->crashes = parse_double(config->crashes,
+			hashtable_search(params_table, "crashes"));
+	config->tick_step = parse_long(config->tick_step,
+			hashtable_search(params_table, "tickstep"));
+	config->seed = parse_long(config->seed, hashtable_search(params_table, "seed"));
+}
+
+/* xorshift64* */
+static double uniform(sim_t *sim) {
+	sim->rng ^= sim->rng >> 12;
+	sim->rng ^= sim->rng << 25;
+	sim->rng ^= sim->rng >> 27;
+	return ((sim->rng * 2685821657736338717ull >> 11) + 0.5) / 9007199254740992.;
+}
+
+static double normal(sim_t *sim) {
+	return sqrt(-2 * log(uniform(sim))) * cos(2 * M_PI * uniform(sim));
+}
+
+/* Marsaglia and Tsang, with unit scale. */
+static double gamma_sample(sim_t *sim, double shape) {
+	double d, c;
+
+	if (shape < 1) {
+		return gamma_sample(sim, shape + 1) * pow(uniform(sim), 1 / shape);
+	}
+	d = shape - 1. / 3;
+	c = 1 / sqrt(9 * d);
+	for (;;) {
+		double x = normal(sim);
+		double v = 1 + c * x;
+		double u;
+
+		if (v <= 0) {
+			continue;
+		}
+		v = v * v * v;
+		u = uniform(sim);
+		if (log(u) < x * x / 2 + d - d * v + d * log(v)) {
+			return d * v;
+		}
+	}
+}
+
+static long sample_delay(sim_t *sim) {
+	fd_sim_config_t *config = sim->config;
+	double delay = config->delay;
+	double alpha = config->pareto_alpha;
+
+	switch (config->delay_model) {
+	case SIM_NORMAL:
+		delay += config->delay_sd * normal(sim);
+		break;
+	case SIM_GAMMA:
+		delay *= gamma_sample(sim, config->gamma_shape) / config->gamma_shape;
+		break;
+	case SIM_PARETO:
+		delay *= (alpha - 1) / alpha * pow(uniform(sim), -1 / alpha);
+		break;
+	}
+	return delay > 0 ? (long)(delay + 0.5) : 0;
+}
+
+static int before(sim_event_t *a, sim_event_t *b) {
+	return a->time < b->time || (a->time == b->time && a->type < b->type);
+}
+
+static int push(sim_t *sim, sim_event_t event) {
+	long i = sim->count++;
+
+	if (sim->count > sim->capacity) {
+		sim_event_t *heap = realloc(sim->heap, 2 * sim->capacity * sizeof(*heap));
+		if (!heap) {
+			sim->count--;
+			return 0;
+		}
+		sim->heap = heap;
+		sim->capacity *= 2;
+	}
+	while (i > 0 && before(&event, &sim->heap[(i - 1) / 2])) {
+		sim->heap[i] = sim->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	sim->heap[i] = event;
+	return 1;
+}
+
+static sim_event_t pop(sim_t *sim) {
+	sim_event_t top = sim->heap[0];
+	sim_event_t last = sim->heap[--sim->count];
+	long i = 0;
+
+	for (;;) {
+		long child = 2 * i + 1;
+
+		if (child >= sim->count) {
+			break;
+		}
+		if (child + 1 < sim->count && before(&sim->heap[child + 1], &sim->heap[child])) {
+			child++;
+		}
+		if (!before(&sim->heap[child], &last)) {
+			break;
+		}
+		sim->heap[i] = sim->heap[child];
+		i = child;
+	}
+	sim->heap[i] = last;
+	return top;
+}
+
+/* Queues an event, at or after the current time. */
+static int queue(sim_t *sim, long time, int node, int type) {
+	sim_event_t event = { time, node, type, -1 };
+	int *list = &sim->slots[2 * (time & (sim->wheel - 1)) + (type > SIM_CRASH)];
+	int i = sim->free;
+
+	if (time - sim->now >= sim->wheel) {
+		return push(sim, event);
+	}
+	if (i < 0) {
+		if (sim->events_count == sim->events_capacity) {
+			sim_event_t *events = realloc(sim->events,
+					2 * sim->events_capacity * sizeof(*events));
+			if (!events) {
+				return 0;
+			}
+			sim->events = events;
+			sim->events_capacity *= 2;
+		}
+		i = sim->events_count++;
+	} else {
+		sim->free = sim->events[i].next;
+	}
+	event.next = *list;
+	sim->events[i] = event;
+	*list = i;
+	return 1;
+}
+
+static char* node_id(sim_t *sim, int node) {
+	return sim->ids + (long)node * SIM_ID_LEN;
+}
+
+/* Time the detector's timeout runs out, judged from what it last heard. */
+static long deadline(sim_t *sim, int node, long now) {
+	char *id = node_id(sim, node);
+	return now - sim->fd->get_idle_time(sim->fd, id, now)
+			+ sim->fd->get_timeout(sim->fd, id) + 1;
+}
+
+/* Checks are queued lazily, one per monitored: a check that finds the
+ * deadline moved by a heartbeat requeues itself for the new one. */
+static int schedule_check(sim_t *sim, int node) {
+	sim_node_t *n = &sim->nodes[node];
+
+	if (n->checking) {
+		return 1;
+	}
+	n->checking = 1;
+	return queue(sim, n->deadline, node, SIM_CHECK);
+}
+
+static void detected(sim_t *sim, sim_node_t *n, long now) {
+	fd_sim_result_t *result = sim->result;
+	long detection = now - n->crash_at;
+
+	n->done = 1;
+	result->detected++;
+	result->detection_mean += detection;
+	if (detection > result->detection_max) {
+		result->detection_max = detection;
+	}
+}
+
+/* Draws the monitored's heartbeats after the last one sent, up to the
+ * next that gets through, and queues its arrival. Delivery is in order, as
+ * over the session's connection, so a heartbeat is never delivered before
+ * the one that arrived at after: drawing it only then keeps a single event
+ * per heartbeat. */
+static int next_heartbeat(sim_t *sim, int node, long after) {
+	fd_sim_config_t *config = sim->config;
+	sim_node_t *n = &sim->nodes[node];
+
+	for (;;) {
+		long arrival;
+
+		n->sent += config->interval;
+		if (uniform(sim) < config->gc_rate * config->interval / 1000) {
+			n->sent += config->gc_pause;
+		}
+		if (n->sent >= n->crash_at || n->sent > config->duration) {
+			return 1;
+		}
+		sim->result->heartbeats++;
+		if (n->burst ? uniform(sim) < config->burst_exit :
+				uniform(sim) < config->burst_enter) {
+			n->burst = !n->burst;
+		}
+		if (n->burst || uniform(sim) < config->loss) {
+			sim->result->lost++;
+			continue;
+		}
+		arrival = n->sent + sample_delay(sim);
+		return queue(sim, arrival > after ? arrival : after, node, SIM_ARRIVE);
+	}
+}
+
+static int arrive(sim_t *sim, int node, long now) {
+	sim_node_t *n = &sim->nodes[node];
+
+	if (n->done) {
+		return 1;
+	}
+	sim->fd->message_received(sim->fd, node_id(sim, node), now, PING);
+	n->heard = now;
+	if (n->suspected_at >= 0) {
+		sim->result->mistake_time += now - n->suspected_at;
+		n->suspected_at = -1;
+		if (!schedule_check(sim, node)) {
+			return 0;
+		}
+	}
+	return next_heartbeat(sim, node, now);
+}
+
+/* A wrong suspicion still standing when the monitored crashes becomes a
+ * right one. */
+static void crash(sim_t *sim, int node) {
+	sim_node_t *n = &sim->nodes[node];
+
+	if (!n->done && n->suspected_at >= 0) {
+		sim->result->mistake_time += n->crash_at - n->suspected_at;
+		n->suspected_at = -1;
+		detected(sim, n, n->crash_at);
+	}
+}
+
+static int check(sim_t *sim, int node, long now) {
+	sim_node_t *n = &sim->nodes[node];
+
+	n->checking = 0;
+	if (n->done || n->suspected_at >= 0) {
+		return 1;
+	}
+	if (n->deadline_heard != n->heard) {
+		n->deadline = deadline(sim, node, now);
+		n->deadline_heard = n->heard;
+	}
+	if (n->deadline > now) {
+		return schedule_check(sim, node);
+	}
+	if (!sim->fd->is_failed(sim->fd, node_id(sim, node), now)) {
+		/* the detector moved its timeout without hearing anything */
+		n->deadline = deadline(sim, node, now);
+		if (n->deadline < now + sim->recheck) {
+			n->deadline = now + sim->recheck;
+		}
+		return schedule_check(sim, node);
+	}
+	if (now >= n->crash_at) {
+		detected(sim, n, now);
+	} else {
+		sim->result->mistakes++;
+		n->suspected_at = now;
+	}
+	return 1;
+}
+
+static long cpu_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000l + ts.tv_nsec;
+}
+
+static int simulate(sim_t *sim) {
+	fd_sim_config_t *config = sim->config;
+	fdetector_t *fd = sim->fd;
+	int ok = 1;
+	int i;
+
+	for (i = 0; ok && i < config->monitoreds; i++) {
+		sim_node_t *n = &sim->nodes[i];
+
+		snprintf(node_id(sim, i), SIM_ID_LEN, "sim-%d", i);
+		fd->register_monitored(fd, node_id(sim, i), 0, config->timeout);
+		n->crash_at = uniform(sim) < config->crashes ?
+				(long)(uniform(sim) * config->duration) : LONG_MAX;
+		n->sent = (long)(uniform(sim) * config->interval) - config->interval;
+		n->suspected_at = -1;
+		n->deadline = deadline(sim, i, 0);
+		ok = next_heartbeat(sim, i, 0) && schedule_check(sim, i);
+		if (ok && n->crash_at != LONG_MAX) {
+			sim->result->crashed++;
+			ok = queue(sim, n->crash_at, i, SIM_CRASH);
+		}
+	}
+	if (ok && fd->tick && config->tick_step > 0) {
+		ok = queue(sim, config->tick_step, -1, SIM_TICK);
+	}
+
+	for (; ok && sim->now <= config->duration; sim->now++) {
+		int list;
+
+		while (ok && sim->count && sim->heap[0].time - sim->now < sim->wheel) {
+			sim_event_t event = pop(sim);
+			ok = queue(sim, event.time, event.node, event.type);
+		}
+		for (list = 0; list < 2; list++) {
+			int *head = &sim->slots[2 * (sim->now & (sim->wheel - 1)) + list];
+
+			while (ok && *head >= 0) {
+				int i = *head;
+				sim_event_t event = sim->events[i];
+
+				*head = event.next;
+				sim->events[i].next = sim->free;
+				sim->free = i;
+				sim->result->events++;
+				switch (event.type) {
+				case SIM_ARRIVE:
+					ok = arrive(sim, event.node, event.time);
+					break;
+				case SIM_CRASH:
+					crash(sim, event.node);
+					break;
+				case SIM_CHECK:
+					ok = check(sim, event.node, event.time);
+					break;
+				case SIM_TICK:
+					fd_tick(fd, event.time);
+					ok = queue(sim, event.time + config->tick_step, -1, SIM_TICK);
+					break;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < config->monitoreds; i++) {
+		if (sim->nodes[i].suspected_at >= 0) {
+			sim->result->mistake_time += config->duration - sim->nodes[i].suspected_at;
+		}
+	}
+	return ok;
+}
+
+int run_simulation(fdetector_t *fd, fd_sim_config_t *config,
+		fd_sim_result_t *result) {
+	sim_t sim;
+	long start = cpu_ns();
+	int ok;
+
+	memset(result, 0, sizeof(*result));
+	memset(&sim, 0, sizeof(sim));
+	sim.fd = fd;
+	sim.config = config;
+	sim.result = result;
+	sim.rng = config->seed ? config->seed : 1;
+	sim.recheck = fd->tick && config->tick_step > 0 ? config->tick_step :
+			config->interval / 10 > 0 ? config->interval / 10 : 1;
+	/* spans a heartbeat and a timeout, longer deadlines and crashes go to
+	 * the heap */
+	for (sim.wheel = 1024; sim.wheel < 2 * (config->interval + config->timeout);
+			sim.wheel *= 2);
+	sim.slots = malloc(2 * sim.wheel * sizeof(*sim.slots));
+	/* an arrival, a check and a crash per monitored */
+	sim.events_capacity = 3 * config->monitoreds + 16;
+	sim.events = malloc(sim.events_capacity * sizeof(*sim.events));
+	sim.free = -1;
+	sim.capacity = config->monitoreds / 16 + 16;
+	sim.heap = malloc(sim.capacity * sizeof(*sim.heap));
+	if (sim.slots) {
+		memset(sim.slots, -1, 2 * sim.wheel * sizeof(*sim.slots));
+	}
+	sim.nodes = calloc(config->monitoreds, sizeof(*sim.nodes));
+	sim.ids = malloc((long)config->monitoreds * SIM_ID_LEN);
+
+	ok = sim.slots && sim.events && sim.heap && sim.nodes && sim.ids
+			&& simulate(&sim);
+	if (result->detected) {
+		result->detection_mean /= result->detected;
+	}
+	result->cpu = (cpu_ns() - start) / 1e9;
+
+	free(sim.slots);
+	free(sim.events);
+	free(sim.heap);
+	free(sim.nodes);
+	free(sim.ids);
+	return ok;
+}
@@ -0,0 +1,85 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_SIMULATOR_H_
+#define FD_SIMULATOR_H_
+
+#include "failuredetector.h"
+#include "../hashtable/hashtable.h"
+
+/* Discrete-event simulation of monitoreds sending heartbeats to a
+ * detector over a modelled network, on a virtual clock in milliseconds.
+ * Heartbeat arrivals, crashes and suspicion checks are the only events,
+ * so hours of cluster time run about as fast as the detector takes the
+ * heartbeats. Detectors applying updates asynchronously, as the sharded
+ * one does, answer behind the virtual clock and show it as mistakes. */
+
+enum {
+	SIM_CONSTANT, //every heartbeat takes the mean delay
+	SIM_NORMAL, //normal around the mean, cut at 0
+	SIM_GAMMA,
+	SIM_PARETO //heavy tailed, with the mean delay
+};
+
+typedef struct {
+	int monitoreds;
+	long duration;
+	long interval; //heartbeat period
+	long timeout; //registration timeout
+	int delay_model;
+	double delay; //mean one-way delay
+	double delay_sd; //normal model
+	double gamma_shape;
+	double pareto_alpha; //above 1
+	double loss; //independent loss probability per heartbeat
+	double burst_enter; //per heartbeat, probability of entering a loss burst
+	double burst_exit; //per heartbeat, probability of leaving it
+	double gc_rate; //sender stalls per monitored per second
+	long gc_pause; //length of a stall
+	double crashes; //share of monitoreds crash-stopping at a uniform time
+	long tick_step; //fd_tick period, for detectors with a tick mode
+	unsigned long seed;
+} fd_sim_config_t;
+
+typedef struct {
+	long events;
+	long heartbeats;
+	long lost;
+	long crashed;
+	long detected;
+	double detection_mean; //from crash to suspicion
+	long detection_max;
+	long mistakes; //suspicions of live monitoreds
+	long mistake_time; //summed length of the wrong suspicions
+	double cpu; //seconds spent on the run
+} fd_sim_result_t;
+
+void default_sim_config(fd_sim_config_t *config);
+
+/* Reads the simulation keys of params_table: monitoreds, duration,
+ * interval, timeout, delaymodel (constant, normal, gamma or pareto),
+ * delay, delaysd, gammashape, paretoalpha, loss, burstenter, burstexit,
+ * gcrate, gcpause, crashes, tickstep and seed. */
+void parse_sim_config(fd_sim_config_t *config, struct hashtable *params_table);
+
+/* Registers config->monitoreds ids with fd, which should hold none, and
+ * runs the simulation. Returns 0 when out of memory. */
+int run_simulation(fdetector_t *fd, fd_sim_config_t *config,
+		fd_sim_result_t *result);
+
+#endif /* FD_SIMULATOR_H_ */
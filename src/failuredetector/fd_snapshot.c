@@ -0,0 +1,277 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_snapshot.h"
+#include "failuredetector.h"
+#include "interarrival_window.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(x) (((x) + 7) & ~7l)
+
+typedef struct {
+	fd_state_visitor_t visitor;
+	fd_snapshot_record_t *records;
+	long count;
+	long capacity;
+	char *data;
+	long data_size;
+	long data_capacity;
+	int failed;
+} snapshot_writer_t;
+
+static int reserve(void **buf, long *capacity, long needed, long el_size) {
+	long new_capacity = *capacity ? *capacity : 64;
+	void *p;
+
+	if (needed <= *capacity) {
+		return 1;
+	}
+	while (new_capacity < needed) {
+		new_capacity *= 2;
+	}
+	p = realloc(*buf, new_capacity * el_size);
+	if (!p) {
+		return 0;
+	}
+	*buf = p;
+	*capacity = new_capacity;
+	return 1;
+}
+
+static void write_state(fd_state_visitor_t *visitor, fd_state_t *state) {
+	snapshot_writer_t *w = (snapshot_writer_t*)visitor;
+	fd_snapshot_record_t *r;
+	long id_length = strlen(state->id);
+	long id_size = ALIGN8(id_length + 1);
+	long window_bytes = state->window_size * sizeof(long);
+
+	if (w->failed
+			|| !reserve((void**)&w->records, &w->capacity, w->count + 1, sizeof(*r))
+			|| !reserve((void**)&w->data, &w->data_capacity,
+					w->data_size + id_size + window_bytes, 1)) {
+		w->failed = 1;
+		return;
+	}
+
+	r = &w->records[w->count++];
+	memset(r, 0, sizeof(*r));
+	r->timeout = state->timeout;
+	r->last_heard = state->last_heard;
+	r->last_sent = state->last_sent;
+	r->eta = state->eta;
+	r->ea = state->ea;
+	r->delay = state->delay;
+	r->delta_p = state->delta_p;
+	r->alpha = state->alpha;
+	r->var = state->var;
+	r->error = state->error;
+	r->last_ping = state->last_ping;
+	r->srtt = state->srtt;
+	r->rttvar = state->rttvar;
+	r->id_length = id_length;
+	r->window_size = state->window_size;
+
+	/* offsets are relative to the data area until the layout is known */
+	r->id_offset = w->data_size;
+	memset(w->data + w->data_size, 0, id_size);
+	memcpy(w->data + w->data_size, state->id, id_length);
+	w->data_size += id_size;
+
+	r->interarrivals_offset = w->data_size;
+	if (window_bytes) {
+		memcpy(w->data + w->data_size, state->interarrivals, window_bytes);
+		w->data_size += window_bytes;
+	}
+}
+
+int fd_snapshot(fdetector_t *fd, const char *path) {
+	snapshot_writer_t w;
+	fd_snapshot_header_t header;
+	char *tmp_path;
+	FILE *file;
+	long i, data_start;
+	int ok, saved_errno;
+
+	memset(&w, 0, sizeof(w));
+	w.visitor.visit = write_state;
+	fd->export_states(fd, &w.visitor);
+	if (w.failed) {
+		free(w.records);
+		free(w.data);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	data_start = sizeof(header) + w.count * sizeof(fd_snapshot_record_t);
+	for (i = 0; i < w.count; i++) {
+		w.records[i].id_offset += data_start;
+		w.records[i].interarrivals_offset += data_start;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FD_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = FD_SNAPSHOT_VERSION;
+	header.byte_order = FD_SNAPSHOT_BYTE_ORDER;
+	header.word_size = sizeof(long);
+	header.record_size = sizeof(fd_snapshot_record_t);
+	header.count = w.count;
+	header.file_size = data_start + w.data_size;
+
+	tmp_path = malloc(strlen(path) + 5);
+	if (!tmp_path) {
+		free(w.records);
+		free(w.data);
+		errno = ENOMEM;
+		return -1;
+	}
+	sprintf(tmp_path, "%s.tmp", path);
+
+	file = fopen(tmp_path, "wb");
+	ok = file != NULL;
+	ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(w.records, sizeof(fd_snapshot_record_t), w.count, file) == (size_t)w.count;
+	ok = ok && fwrite(w.data, 1, w.data_size, file) == (size_t)w.data_size;
+	ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+	saved_errno = errno;
+	if (file && fclose(file) != 0 && ok) {
+		ok = 0;
+		saved_errno = errno;
+	}
+	if (ok && rename(tmp_path, path) != 0) {
+		ok = 0;
+		saved_errno = errno;
+	}
+	if (!ok) {
+		unlink(tmp_path);
+	}
+
+	free(tmp_path);
+	free(w.records);
+	free(w.data);
+	errno = saved_errno;
+	return ok ? 0 : -1;
+}
+
+static int valid_snapshot(char *base, long size) {
+	fd_snapshot_header_t *header = (fd_snapshot_header_t*)base;
+	fd_snapshot_record_t *records;
+	long i;
+
+	if (size < (long)sizeof(*header)
+			|| memcmp(header->magic, FD_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != FD_SNAPSHOT_VERSION
+			|| header->byte_order != FD_SNAPSHOT_BYTE_ORDER
+			|| header->word_size != sizeof(long)
+			|| header->record_size != sizeof(fd_snapshot_record_t)
+			|| header->file_size != size
+			|| header->count < 0
+			|| header->count > (size - (long)sizeof(*header)) / (long)sizeof(*records)) {
+		return 0;
+	}
+
+	records = (fd_snapshot_record_t*)(base + sizeof(*header));
+	for (i = 0; i < header->count; i++) {
+		fd_snapshot_record_t *r = &records[i];
+		if (r->id_length < 0 || r->id_offset < 0
+				|| r->id_offset > size - r->id_length - 1
+				|| base[r->id_offset + r->id_length] != '\0'
+				|| r->window_size < 0 || r->window_size > MAX_SIZE
+				|| r->interarrivals_offset < 0
+				|| r->interarrivals_offset % sizeof(long) != 0
+				|| r->interarrivals_offset
+						> size - r->window_size * (long)sizeof(long)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int fd_restore(fdetector_t *fd, const char *path) {
+	struct stat st;
+	fd_snapshot_header_t *header;
+	fd_snapshot_record_t *records;
+	char *base;
+	long i;
+	int file;
+
+	file = open(path, O_RDONLY);
+	if (file < 0) {
+		return -1;
+	}
+	if (fstat(file, &st) != 0) {
+		close(file);
+		return -1;
+	}
+	if (st.st_size < (off_t)sizeof(*header)) {
+		close(file);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* ids and windows are read in place from the mapping; detectors copy
+	 * what they keep, as window_restore does, so it is unmapped once all
+	 * the records are imported */
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	if (!valid_snapshot(base, st.st_size)) {
+		munmap(base, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	header = (fd_snapshot_header_t*)base;
+	records = (fd_snapshot_record_t*)(base + sizeof(*header));
+	for (i = 0; i < header->count; i++) {
+		fd_snapshot_record_t *r = &records[i];
+		fd_state_t state;
+
+		state.id = base + r->id_offset;
+		state.timeout = r->timeout;
+		state.last_heard = r->last_heard;
+		state.last_sent = r->last_sent;
+		state.eta = r->eta;
+		state.ea = r->ea;
+		state.delay = r->delay;
+		state.delta_p = r->delta_p;
+		state.alpha = r->alpha;
+		state.var = r->var;
+		state.error = r->error;
+		state.last_ping = r->last_ping;
+		state.srtt = r->srtt;
+		state.rttvar = r->rttvar;
+		state.window_size = r->window_size;
+		state.interarrivals = (long*)(base + r->interarrivals_offset);
+
+		fd->import_state(fd, &state);
+	}
+
+	munmap(base, st.st_size);
+	return 0;
+}
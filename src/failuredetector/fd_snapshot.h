@@ -0,0 +1,82 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_SNAPSHOT_H_
+#define FD_SNAPSHOT_H_
+
+#include "failuredetector.h"
+
+#define FD_SNAPSHOT_MAGIC "FDSNAP\0"
+#define FD_SNAPSHOT_VERSION 3
+#define FD_SNAPSHOT_BYTE_ORDER 0x01020304
+
+/*
+ * Snapshot file layout (host byte order, 8 byte aligned):
+ *
+ *   fd_snapshot_header_t
+ *   fd_snapshot_record_t[count]
+ *   data: per record, the NUL terminated id padded to 8 bytes followed by
+ *         window_size longs of interarrivals
+ *
+ * Offsets are relative to the start of the file, so a mapped snapshot is
+ * read in place by adding them to the mapping address.
+ */
+typedef struct {
+	char magic[8];
+	int version;
+	int byte_order;
+	int word_size;
+	int record_size;
+	long count;
+	long file_size;
+} fd_snapshot_header_t;
+
+typedef struct {
+	long timeout;
+	long last_heard;
+	long last_sent;
+	long eta;
+
+	long ea;
+	long delay;
+	long delta_p;
+	double alpha;
+	double var;
+	double error;
+
+	long last_ping;
+	long srtt;
+	long rttvar;
+	long id_offset;
+	long interarrivals_offset;
+	int id_length;
+	int window_size;
+} fd_snapshot_record_t;
+
+/* Writes every monitored's state to path, atomically replacing any
+ * previous snapshot. Returns 0 on success, -1 and sets errno otherwise. */
+int fd_snapshot(fdetector_t *fd, const char *path);
+
+/* Loads a snapshot written by fd_snapshot, registering monitoreds that are
+ * not known yet and overwriting the state of those that are. Timestamps are
+ * restored as saved, so the caller must keep using the same clock. Nothing
+ * is imported if the file is not a valid snapshot. Returns 0 on success,
+ * -1 and sets errno otherwise. */
+int fd_restore(fdetector_t *fd, const char *path);
+
+#endif /* FD_SNAPSHOT_H_ */
@@ -19,6 +19,9 @@
 #include "fixed_failuredetector.h"
 #include "failuredetector.h"
 #include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_hot.h"
+#include "fd_memory.h"
 #include "../hashtable/hashtable.h"
 
 #include <stdio.h>
@@ -27,72 +30,194 @@
 
 typedef struct {
 	char* id;
-	long timeout;
-	long last_heard;
-	long last_sent;
-	long ping_interval;
+	fd_hot_t *hot; //what queries read
+	fd_batch_t *batch; //block the record was bulk allocated in, if any
 } monitored_t;
 
+static monitored_t* lookup(fixedfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot ? hot->cold : NULL;
+}
+
+static int init_monitored(fixedfd_t *this, monitored_t *m, long now, long timeout) {
+	m->hot = hot_alloc(&this->hot, m);
+	if (!m->hot) {
+		return 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+	hot_set_last_sent(&this->hot, m->hot, now);
+	hot_set_to(&this->hot, m->hot, timeout);
+	hot_set_eta(&this->hot, m->hot, timeout / 2);
+	return 1;
+}
+
 void fixed_reg_monitored(fixedfd_t *this, char *id, long now, long timeout) {
 	monitored_t *m;
 	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return;
+	}
+
+	if (!init_monitored(this, m, now, timeout)) {
+		free(m);
+		return;
+	}
+	m->id = fd_hashtable_insert(this->monitoreds, id, m->hot);
+}
 
-	m->id = id;
-	m->last_heard = now;
-	m->last_sent = now;
-	m->timeout = timeout;
-	m->ping_interval = timeout / 2;
-
-	fd_hashtable_insert(this->monitoreds, id, m);
+void fixed_reg_in_cohort(fixedfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	fixed_reg_monitored(this, id, now, timeout);
 }
 
 void fixed_set_to(fixedfd_t *this, char *id, long timeout) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->timeout = timeout;
+	monitored_t* m = lookup(this, id);
+	hot_set_to(&this->hot, m->hot, timeout);
 }
 
 long fixed_get_to(fixedfd_t *this, char *id) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->timeout;
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_to(&this->hot, hot);
 }
 
 void fixed_msg_rcv(fixedfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->last_heard = now;
+	monitored_t* m = lookup(this, id);
+	hot_set_last_heard(&this->hot, m->hot, now);
 }
 
 void fixed_msg_sent(fixedfd_t *this, char *id, long now, int type) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->last_sent = now;
+	monitored_t* m = lookup(this, id);
+	hot_set_last_sent(&this->hot, m->hot, now);
 }
 
 int fixed_failed(fixedfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now > m->last_heard + fixed_get_to(this, id);
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now > hot_last_heard(&this->hot, hot) + hot_to(&this->hot, hot);
 }
 
 long fixed_get_idle(fixedfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return now - m->last_heard;
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now - hot_last_heard(&this->hot, hot);
 }
 
-int fixed_time_next_ping(fixedfd_t *this, char *id, long now) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	return m->ping_interval - (now - m->last_sent);
+long fixed_time_next_ping(fixedfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_eta(&this->hot, hot) - (now - hot_last_sent(&this->hot, hot));
 }
 
 int fixed_should_ping(fixedfd_t *this, char *id, long now) {
 	return fixed_time_next_ping(this, id, now) <= 0;
 }
 
+static void destroy_monitored(monitored_t *m) {
+	if (m->batch) {
+		batch_release(m->batch);
+	} else {
+		free(m);
+	}
+}
+
 void fixed_release(fixedfd_t *this, char *id) {
-	monitored_t* m = hashtable_remove(this->monitoreds, id);
-	free(m);
+	fd_hot_t *hot = hashtable_remove(this->monitoreds, id);
+	monitored_t *m = hot->cold;
+
+	hot_free(&this->hot, hot);
+	destroy_monitored(m);
+}
+
+void fixed_reg_many(fixedfd_t *this, char **ids, int count, long now, long timeout) {
+	fd_batch_t *batch;
+	monitored_t *ms;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+	hashtable_reserve(this->monitoreds, hashtable_count(this->monitoreds) + count);
+
+	ms = batch_alloc(&batch, count, sizeof(*ms));
+	if (!ms) {
+		for (i = 0; i < count; i++) {
+			fixed_reg_monitored(this, ids[i], now, timeout);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		monitored_t *m = &ms[i];
+
+		m->batch = batch;
+		if (!init_monitored(this, m, now, timeout)) {
+			batch_release(batch);
+			continue;
+		}
+		m->id = fd_hashtable_insert(this->monitoreds, ids[i], m->hot);
+	}
+}
+
+void fixed_release_many(fixedfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		fixed_release(this, ids[i]);
+	}
 }
 
 void fixed_set_ping_interval(fixedfd_t *this, char *id, long interval) {
-	monitored_t* m = hashtable_search(this->monitoreds, id);
-	m->ping_interval = interval;
+	monitored_t* m = lookup(this, id);
+	hot_set_eta(&this->hot, m->hot, interval);
+}
+
+static void export_monitored(char *id, void *value, void *arg) {
+	hot_export_t *export = arg;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	fd_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	hot_export(export->pool, m->hot, &state);
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void fixed_export_states(fixedfd_t *this, fd_state_visitor_t *visitor) {
+	hot_export_t export = { &this->hot, visitor };
+
+	fd_hashtable_foreach(this->monitoreds, export_monitored, &export);
+}
+
+void fixed_import_state(fixedfd_t *this, fd_state_t *state) {
+	monitored_t* m = lookup(this, state->id);
+	if (!m) {
+		fixed_reg_monitored(this, state->id, state->last_heard, state->timeout);
+		m = lookup(this, state->id);
+		if (!m) {
+			return;
+		}
+	}
+
+	hot_import(&this->hot, m->hot, state);
+}
+
+void fixed_memory_usage(fixedfd_t *this, fd_memory_t *usage) {
+	memory_add_table(usage, this->monitoreds);
+	usage->records += hashtable_count(this->monitoreds) * sizeof(monitored_t)
+			+ hot_pool_memory(&this->hot);
+	memory_total(usage);
+}
+
+/* Timeouts are set per monitored, there is nothing to reconfigure. */
+void fixed_reconfigure(fixedfd_t *this, struct hashtable *params_table) {
+}
+
+static void destroy_value(char *id, void *value, void *arg) {
+	destroy_monitored(((fd_hot_t*) value)->cold);
+}
+
+void fixed_destroy(fixedfd_t *this) {
+	fd_hashtable_foreach(this->monitoreds, destroy_value, NULL);
+	hashtable_destroy(this->monitoreds, 0);
+	hot_pool_destroy(&this->hot);
+	free(this);
 }
 
 fixedfd_t* fixedfd_init() {
@@ -102,6 +227,7 @@ fixedfd_t* fixedfd_init() {
 	p_fd->fdetector.message_received = (void*)fixed_msg_rcv;
 	p_fd->fdetector.message_sent = (void*)fixed_msg_sent;
 	p_fd->fdetector.register_monitored = (void*)fixed_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)fixed_reg_in_cohort;
 	p_fd->fdetector.set_timeout = (void*)fixed_set_to;
 	p_fd->fdetector.get_timeout = (void*)fixed_get_to;
 	p_fd->fdetector.is_failed = (void*)fixed_failed;
@@ -109,7 +235,14 @@ fixedfd_t* fixedfd_init() {
 	p_fd->fdetector.get_time_to_next_ping = (void*)fixed_time_next_ping;
 	p_fd->fdetector.should_ping = (void*)fixed_should_ping;
 	p_fd->fdetector.release_monitored = (void*)fixed_release;
+	p_fd->fdetector.register_many = (void*)fixed_reg_many;
+	p_fd->fdetector.release_many = (void*)fixed_release_many;
 	p_fd->fdetector.set_ping_interval = (void*)fixed_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)fixed_export_states;
+	p_fd->fdetector.import_state = (void*)fixed_import_state;
+	p_fd->fdetector.memory_usage = (void*)fixed_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)fixed_reconfigure;
+	p_fd->fdetector.destroy = (void*)fixed_destroy;
 
 	p_fd->monitoreds = create_fd_hashtable();
 	return p_fd;
@@ -21,10 +21,12 @@
 
 #include "../hashtable/hashtable.h"
 #include "failuredetector.h"
+#include "fd_hot.h"
 
 typedef struct {
 	fdetector_t fdetector;
-	struct hashtable *monitoreds;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
 } fixedfd_t;
 
 fixedfd_t* fixedfd_init();
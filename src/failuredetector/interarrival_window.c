@@ -17,69 +17,567 @@
  */
 
 #include "interarrival_window.h"
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define WINDOW_AVX2
+#include <immintrin.h>
+#endif
+
+#define MIN_CAPACITY 16
+/* CUSUM allowance and alarm threshold, in deviations. Samples count for
+ * at most CHANGE_CLAMP deviations, so that a lone outlier such as a
+ * stall cannot raise an alarm by itself. */
+#define CHANGE_SLACK 0.5
+#define CHANGE_THRESHOLD 8.
+#define CHANGE_CLAMP 2.
+/* smallest deviation samples are measured in, as a fraction of the mean,
+ * for windows of nearly constant interarrivals */
+#define CHANGE_MIN_CV 16
+
+typedef struct {
+	long sum;
+	window_sum_sq_t sum_sq;
+	long min;
+	long max;
+} window_sums_t;
+
+static void sums_scalar(const long *v, int n, window_sums_t *sums) {
+	int i;
+	for (i = 0; i < n; i++) {
+		sums->sum += v[i];
+		sums->sum_sq += (window_sum_sq_t)v[i] * v[i];
+		if (v[i] < sums->min) {
+			sums->min = v[i];
+		}
+		if (v[i] > sums->max) {
+			sums->max = v[i];
+		}
+	}
+}
+
+#ifdef WINDOW_AVX2
+
+/* Squares are accumulated in 64 bit lanes only when every sample is below
+ * 2^26, so that a window's worth of them cannot overflow a lane. */
+#define SMALL_SAMPLE (1l << 26)
+
+__attribute__((target("avx2")))
+static void sums_avx2(const long *v, int n, window_sums_t *sums) {
+	__m256i sum = _mm256_setzero_si256();
+	__m256i sum_sq = _mm256_setzero_si256();
+	__m256i min = _mm256_set1_epi64x(sums->min);
+	__m256i max = _mm256_set1_epi64x(sums->max);
+	long lanes[4];
+	window_sum_sq_t sq = 0;
+	int i, j;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+		sum = _mm256_add_epi64(sum, x);
+		sum_sq = _mm256_add_epi64(sum_sq, _mm256_mul_epi32(x, x));
+		min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+		max = _mm256_blendv_epi8(max, x, _mm256_cmpgt_epi64(x, max));
+	}
+
+	_mm256_storeu_si256((__m256i*)lanes, sum);
+	sums->sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm256_storeu_si256((__m256i*)lanes, sum_sq);
+	for (j = 0; j < 4; j++) {
+		sq += lanes[j];
+	}
+	_mm256_storeu_si256((__m256i*)lanes, min);
+	for (j = 0; j < 4; j++) {
+		if (lanes[j] < sums->min) {
+			sums->min = lanes[j];
+		}
+	}
+	_mm256_storeu_si256((__m256i*)lanes, max);
+	for (j = 0; j < 4; j++) {
+		if (lanes[j] > sums->max) {
+			sums->max = lanes[j];
+		}
+	}
+
+	if (sums->min > -SMALL_SAMPLE && sums->max < SMALL_SAMPLE) {
+		sums->sum_sq += sq;
+	} else {
+		for (j = 0; j < i; j++) {
+			sums->sum_sq += (window_sum_sq_t)v[j] * v[j];
+		}
+	}
+
+	/* the remaining samples */
+	v += i;
+	n -= i;
+	for (i = 0; i < n; i++) {
+		sums->sum += v[i];
+		sums->sum_sq += (window_sum_sq_t)v[i] * v[i];
+		if (v[i] < sums->min) {
+			sums->min = v[i];
+		}
+		if (v[i] > sums->max) {
+			sums->max = v[i];
+		}
+	}
+}
+
+#endif
+
+static void sums_narrow(const unsigned int *v, int n, window_sums_t *sums) {
+	unsigned long sum = 0;
+	window_sum_sq_t sum_sq = 0;
+	unsigned int min = UINT_MAX, max = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sum += v[i];
+		sum_sq += (unsigned long)v[i] * v[i];
+		min = v[i] < min ? v[i] : min;
+		max = v[i] > max ? v[i] : max;
+	}
+	sums->sum += sum;
+	sums->sum_sq += sum_sq;
+	if (n && min < sums->min) {
+		sums->min = min;
+	}
+	if (n && max > sums->max) {
+		sums->max = max;
+	}
+}
+
+static void (*sums_kernel)(const long *v, int n, window_sums_t *sums);
+
+static void window_sums(const long *v, int n, window_sums_t *sums) {
+	void (*kernel)(const long*, int, window_sums_t*) =
+			__atomic_load_n(&sums_kernel, __ATOMIC_RELAXED);
+
+	if (!kernel) {
+		kernel = sums_scalar;
+#ifdef WINDOW_AVX2
+		if (__builtin_cpu_supports("avx2")) {
+			kernel = sums_avx2;
+		}
+#endif
+		__atomic_store_n(&sums_kernel, kernel, __ATOMIC_RELAXED);
+	}
+	kernel(v, n, sums);
+}
+
+static void update_mean(interarrival_window_t *window) {
+	window->mean = window->size ? (double)window->sum / window->size : 0;
+}
+
+static int fits_narrow(long interarrival) {
+	return interarrival >= 0 && interarrival <= UINT_MAX;
+}
+
+static size_t sample_size(int narrow) {
+	return narrow ? sizeof(unsigned int) : sizeof(long);
+}
+
+static long sample(interarrival_window_t *window, int i) {
+	return window->narrow ? ((unsigned int*)window->samples)[i]
+			: ((long*)window->samples)[i];
+}
+
+static void set_sample(interarrival_window_t *window, int i, long interarrival) {
+	if (window->narrow) {
+		((unsigned int*)window->samples)[i] = interarrival;
+	} else {
+		((long*)window->samples)[i] = interarrival;
+	}
+}
+
+/* Installs a buffer of capacity samples, accounting for the change. */
+static void set_buffer(interarrival_window_t *window, void *samples,
+		int capacity, int narrow) {
+	if (window->bytes) {
+		*window->bytes += (long)capacity * sample_size(narrow)
+				- (long)window->capacity * sample_size(window->narrow);
+	}
+	window->samples = samples;
+	window->capacity = capacity;
+	window->narrow = narrow;
+}
+
+/* Moves the samples to a buffer of the given width, keeping their
+ * positions in the ring. */
+static int convert(interarrival_window_t *window, int narrow) {
+	interarrival_window_t converted = *window;
+	void *samples;
+	int i;
+
+	if (!window->capacity) {
+		window->narrow = narrow;
+		return 1;
+	}
+	samples = malloc(window->capacity * sample_size(narrow));
+	if (!samples) {
+		return 0;
+	}
+	converted.samples = samples;
+	converted.narrow = narrow;
+	for (i = 0; i < window->size; i++) {
+		int at = (window->start + i) % window->capacity;
+		set_sample(&converted, at, sample(window, at));
+	}
+	free(window->samples);
+	set_buffer(window, samples, window->capacity, narrow);
+	return 1;
+}
+
+static void slice_sums(interarrival_window_t *window, int from, int n,
+		window_sums_t *sums) {
+	if (window->narrow) {
+		sums_narrow((unsigned int*)window->samples + from, n, sums);
+	} else {
+		window_sums((long*)window->samples + from, n, sums);
+	}
+}
+
+/* Rebuilds sums and bounds from the samples. The sums are exact already,
+ * this mainly tightens min and max after large samples left the window,
+ * which is also when a compact window can narrow its samples again. */
+static void recompute(interarrival_window_t *window) {
+	window_sums_t sums = { 0, 0, LONG_MAX, LONG_MIN };
+	int first = window->capacity - window->start;
+
+	if (first > window->size) {
+		first = window->size;
+	}
+	slice_sums(window, window->start, first, &sums);
+	slice_sums(window, 0, window->size - first, &sums);
+
+	window->sum = sums.sum;
+	window->sum_sq = sums.sum_sq;
+	window->min = window->size ? sums.min : 0;
+	window->max = window->size ? sums.max : 0;
+	window->since_recompute = 0;
+	update_mean(window);
+
+	if (window->compact && !window->narrow && fits_narrow(window->min)
+			&& fits_narrow(window->max)) {
+		convert(window, 1);
+	}
+}
+
+int window_limit(interarrival_window_t *window) {
+	return window->limit ? window->limit : MAX_SIZE;
+}
+
+int window_holds(interarrival_window_t *window, int size) {
+	int limit = window_limit(window);
+	return window->size >= (size < limit ? size : limit);
+}
+
+/* The buffer only grows before the window is full, when it has not
+ * wrapped around yet, so growing it never has to move samples. */
+static int grow(interarrival_window_t *window) {
+	int capacity = window->capacity ? window->capacity * 2 : MIN_CAPACITY;
+	void *samples;
+
+	if (capacity > window_limit(window)) {
+		capacity = window_limit(window);
+	}
+	samples = realloc(window->samples,
+			capacity * sample_size(window->narrow));
+	if (!samples) {
+		return 0;
+	}
+	set_buffer(window, samples, capacity, window->narrow);
+	return 1;
+}
 
 interarrival_window_t* init_window() {
 	interarrival_window_t *window;
 	window = calloc(1, sizeof(*window));
+	if (!window) {
+		return NULL;
+	}
 	window->size = 0;
 
 	return window;
 }
 
-void update_mean(interarrival_window_t* window, window_el_t *added,
-		window_el_t *removed) {
+static void replace(interarrival_window_t *window, long *interarrivals,
+		int size);
 
-	int size = window->size;
+/* Keeps the keep most recent samples only. */
+static void restart(interarrival_window_t *window, int keep) {
+	long *interarrivals = malloc(keep * sizeof(long));
+	int i;
 
-	if (!removed) {
-		window->mean = (window->mean * (size-1) + added->interarrival) / size;
-	} else {
-		window->mean += (added->interarrival - removed->interarrival) / size;
+	if (!interarrivals) {
+		return;
+	}
+	for (i = 0; i < keep; i++) {
+		interarrivals[i] = sample(window,
+				(window->start + window->size - keep + i) % window->capacity);
 	}
+	replace(window, interarrivals, keep);
+	free(interarrivals);
+	window->change_points++;
+}
+
+/* Adds the standardised sample to both CUSUMs, restarting the window at
+ * the point the alarming sum started rising from. */
+static void detect_change(interarrival_window_t *window, long interarrival) {
+	double sd = sqrt(window_var(window));
+	double z;
+	int run;
+
+	if (sd * CHANGE_MIN_CV < window->mean) {
+		sd = window->mean / CHANGE_MIN_CV;
+	}
+	z = (interarrival - window->mean) / (sd > 1 ? sd : 1);
+	z = fmin(fmax(z, -CHANGE_CLAMP), CHANGE_CLAMP);
+
+	window->cusum_high = fmax(0, window->cusum_high + z - CHANGE_SLACK);
+	window->run_high = window->cusum_high > 0 ? window->run_high + 1 : 0;
+	window->cusum_low = fmax(0, window->cusum_low - z - CHANGE_SLACK);
+	window->run_low = window->cusum_low > 0 ? window->run_low + 1 : 0;
+
+	if (window->cusum_high <= CHANGE_THRESHOLD
+			&& window->cusum_low <= CHANGE_THRESHOLD) {
+		return;
+	}
+	/* the new sample is added after the restart */
+	run = (window->cusum_high > CHANGE_THRESHOLD ? window->run_high
+			: window->run_low) - 1;
+	if (run < CHANGE_MIN_KEEP) {
+		run = CHANGE_MIN_KEEP;
+	}
+	restart(window, run < window->size ? run : window->size);
 }
 
 void add_interarrival(interarrival_window_t* window, long interarrival) {
-	window_el_t *window_el;
-	window_el = calloc(1, sizeof(*window_el));
-	window_el->interarrival = interarrival;
+	int limit;
+	int end;
 
-	if (!window->head) {
-		window->head = window_el;
-		window->tail = window_el;
-	} else {
-		window->tail->next = window_el;
+	if (window->detect_changes && window->size >= CHANGE_MIN_SAMPLES) {
+		detect_change(window, interarrival);
 	}
-	window->size++;
+	limit = window_limit(window);
 
-	window_el_t *removed = NULL;
-	if (window->size > MAX_SIZE) {
-		removed = window->head;
-		window->head = removed->next;
-		window->size--;
+	if (window->size == window->capacity && window->size < limit
+			&& !grow(window)) {
+		return;
+	}
+	/* a sample that does not fit widens the whole window */
+	if (window->narrow && !fits_narrow(interarrival) && !convert(window, 0)) {
+		return;
 	}
 
-	update_mean(window, window_el, removed);
+	/* the buffer is never larger than the limit, so it is full here */
+	if (window->size == limit) {
+		long removed = sample(window, window->start);
+		window->sum -= removed;
+		window->sum_sq -= (window_sum_sq_t)removed * removed;
+		window->start = (window->start + 1) % window->capacity;
+		window->size--;
+	}
 
-	free(removed);
-}
+	end = (window->start + window->size) % window->capacity;
+	set_sample(window, end, interarrival);
+	window->sum += interarrival;
+	window->sum_sq += (window_sum_sq_t)interarrival * interarrival;
+	if (!window->size || interarrival < window->min) {
+		window->min = interarrival;
+	}
+	if (!window->size || interarrival > window->max) {
+		window->max = interarrival;
+	}
+	window->size++;
 
-void destroy_el(window_el_t *el) {
-	if (el) {
-		window_el_t *next = el->next;
-		free(el);
-		destroy_el(next);
+	if (++window->since_recompute >= RECOMPUTE_PERIOD) {
+		recompute(window);
+	} else {
+		update_mean(window);
 	}
 }
 
 void destroy_window(interarrival_window_t *window) {
-	destroy_el(window->head);
+	free(window->samples);
+	set_buffer(window, NULL, 0, 0);
 	free(window);
 }
 
+double window_var(interarrival_window_t *window) {
+	window_sum_sq_t n = window->size;
+
+	if (window->size < 2) {
+		return 0;
+	}
+	return (double)(n * window->sum_sq - (window_sum_sq_t)window->sum * window->sum)
+			/ ((double)n * n);
+}
+
+void window_stats(interarrival_window_t *window, window_stats_t *stats) {
+	recompute(window);
+	stats->size = window->size;
+	stats->mean = window->mean;
+	stats->var = window_var(window);
+	stats->min = window->min;
+	stats->max = window->max;
+}
+
+void window_init(interarrival_window_t *window) {
+	memset(window, 0, sizeof(*window));
+}
+
+void window_clear(interarrival_window_t *window) {
+	free(window->samples);
+	set_buffer(window, NULL, 0, 0);
+	window_init(window);
+}
+
+void add_implicit_ping(interarrival_window_t* window, long ping,
+		long interarrival) {
+	add_interarrival(window, interarrival);
+	window->last_ping = ping;
+}
+
 void add_ping(interarrival_window_t* window, long ping) {
 	if (window->last_ping) {
 		add_interarrival(window, ping - window->last_ping);
 	}
 	window->last_ping = ping;
 }
+
+int window_copy(interarrival_window_t *window, long *interarrivals) {
+	int i;
+
+	if (!window->narrow) {
+		int first = window->capacity - window->start;
+
+		if (first > window->size) {
+			first = window->size;
+		}
+		memcpy(interarrivals, (long*)window->samples + window->start,
+				first * sizeof(long));
+		memcpy(interarrivals + first, window->samples,
+				(window->size - first) * sizeof(long));
+		return window->size;
+	}
+	for (i = 0; i < window->size; i++) {
+		interarrivals[i] = sample(window, (window->start + i) % window->capacity);
+	}
+	return window->size;
+}
+
+/* Replaces the buffer with one holding exactly the given interarrivals,
+ * keeping the limit and the accounting. */
+static void replace(interarrival_window_t *window, long *interarrivals,
+		int size) {
+	int narrow = window->compact;
+	void *buffer;
+	int i;
+
+	for (i = 0; i < size && narrow; i++) {
+		narrow = fits_narrow(interarrivals[i]);
+	}
+	buffer = malloc((size ? size : 1) * sample_size(narrow));
+
+	free(window->samples);
+	set_buffer(window, NULL, 0, 0);
+	window->start = 0;
+	window->size = 0;
+	window->cusum_high = 0;
+	window->cusum_low = 0;
+	window->run_high = 0;
+	window->run_low = 0;
+	if (buffer) {
+		set_buffer(window, buffer, size ? size : 1, narrow);
+		for (i = 0; i < size; i++) {
+			set_sample(window, i, interarrivals[i]);
+		}
+		window->size = size;
+	}
+	recompute(window);
+}
+
+void window_restore(interarrival_window_t *window, long last_ping,
+		long *interarrivals, int size) {
+	if (size > window_limit(window)) {
+		interarrivals += size - window_limit(window);
+		size = window_limit(window);
+	}
+	replace(window, interarrivals, size);
+	window->last_ping = last_ping;
+}
+
+void window_account(interarrival_window_t *window, long *bytes) {
+	int capacity = window->capacity;
+
+	window->bytes = bytes;
+	window->capacity = 0;
+	set_buffer(window, window->samples, capacity, window->narrow);
+}
+
+void window_set_limit(interarrival_window_t *window, int limit) {
+	long *interarrivals;
+	int size;
+
+	if (limit <= 0 || limit > MAX_SIZE) {
+		limit = MAX_SIZE;
+	}
+	if (limit < WINDOW_MIN_LIMIT) {
+		limit = WINDOW_MIN_LIMIT;
+	}
+	window->limit = limit;
+	if (window->capacity <= limit && !window->start) {
+		return;
+	}
+
+	/* move the most recent interarrivals to a buffer that fits them */
+	interarrivals = malloc(MAX_SIZE * sizeof(long));
+	if (!interarrivals) {
+		return;
+	}
+	size = window_copy(window, interarrivals);
+	if (size > limit) {
+		replace(window, interarrivals + size - limit, limit);
+	} else {
+		replace(window, interarrivals, size);
+	}
+	free(interarrivals);
+}
+
+void window_set_compact(interarrival_window_t *window, int compact) {
+	window->compact = compact;
+	if (compact && !window->narrow) {
+		recompute(window);
+	} else if (!compact && window->narrow) {
+		convert(window, 0);
+	}
+}
+
+void window_detect_changes(interarrival_window_t *window, int detect) {
+	window->detect_changes = detect;
+	window->cusum_high = 0;
+	window->cusum_low = 0;
+	window->run_high = 0;
+	window->run_low = 0;
+}
+
+void window_seed(interarrival_window_t *window, double mean, double var,
+		int weight) {
+	long sd = (long)round(sqrt(var));
+	long m = (long)round(mean);
+	int i;
+
+	if (sd > m) {
+		sd = m;
+	}
+	for (i = 0; i < weight && i < MAX_SIZE; i++) {
+		if (i == weight - 1 && weight % 2) {
+			add_interarrival(window, m);
+		} else {
+			add_interarrival(window, i % 2 ? m + sd : m - sd);
+		}
+	}
+}
@@ -19,22 +19,113 @@
 #ifndef INTERARRIVAL_WINDOW_H_
 #define INTERARRIVAL_WINDOW_H_
 #define MAX_SIZE 1000
+/* insertions between two full recomputations of the window statistics */
+#define RECOMPUTE_PERIOD MAX_SIZE
+/* smallest limit a window can be shrunk to */
+#define WINDOW_MIN_LIMIT 16
+/* samples a window needs before it looks for change points */
+#define CHANGE_MIN_SAMPLES 64
+/* samples kept at least when a window restarts at a change point */
+#define CHANGE_MIN_KEEP 8
 
-typedef struct window_el {
-	long interarrival;
-	struct window_el *next;
-} window_el_t;
+#ifdef __SIZEOF_INT128__
+typedef __int128 window_sum_sq_t;
+#else
+typedef long double window_sum_sq_t;
+#endif
 
+/* The interarrivals are kept in a ring buffer grown up to the window's
+ * limit, with exact integer sums so that mean and variance never drift.
+ * Compact windows store them in 32 bits while they fit, and fall back to
+ * 64 bits while a sample that does not fit is in the window.
+ *
+ * Windows detecting changes run a two sided CUSUM of each new sample
+ * against the window's mean and deviation. When the link's interarrivals
+ * shift, the window restarts from the samples since the shift began, so
+ * the estimates follow within a few pings instead of a window's length. */
 typedef struct {
 	int size;
+	int start; //index of the oldest interarrival
+	int capacity;
+	int limit; //interarrivals kept, 0 for MAX_SIZE
+	int since_recompute;
+	int compact; //store the samples in 32 bits when they fit
+	int narrow; //the samples are currently stored in 32 bits
 	double mean;
 	long last_ping;
-	window_el_t* head;
-	window_el_t* tail;
+	long sum;
+	window_sum_sq_t sum_sq;
+	long min; //bounds of the window, tight after each recomputation
+	long max;
+	void *samples; //long, or unsigned int when narrow
+	long *bytes; //counter the buffer's size is accounted in, if any
+	int detect_changes;
+	int change_points; //restarts so far
+	int run_high; //samples since the upper sum last left 0
+	int run_low;
+	double cusum_high; //in deviations
+	double cusum_low;
 } interarrival_window_t;
 
+typedef struct {
+	int size;
+	double mean;
+	double var;
+	long min;
+	long max;
+} window_stats_t;
+
 interarrival_window_t* init_window();
 void add_ping(interarrival_window_t *window, long ping);
+/* Records an arrival standing in for a ping, with the interarrival the
+ * caller derived for it. */
+void add_implicit_ping(interarrival_window_t *window, long ping,
+		long interarrival);
 void destroy_window(interarrival_window_t *window);
 
+/* Variance of the window, from the running sums. */
+double window_var(interarrival_window_t *window);
+
+/* Recomputes the statistics from the samples, tightening min and max, and
+ * fills stats with them. */
+void window_stats(interarrival_window_t *window, window_stats_t *stats);
+
+/* Initialises a window embedded in caller owned memory. */
+void window_init(interarrival_window_t *window);
+/* Frees the samples of a window initialised with window_init. */
+void window_clear(interarrival_window_t *window);
+
+/* Copies the window's interarrivals, oldest first, into a caller provided
+ * buffer of at least MAX_SIZE elements. Returns the number copied. */
+int window_copy(interarrival_window_t *window, long *interarrivals);
+
+/* Replaces the window's contents with the given interarrivals. */
+void window_restore(interarrival_window_t *window, long last_ping,
+		long *interarrivals, int size);
+
+/* Fills the window with weight pseudo samples having the given mean and
+ * variance, to be aged out by real interarrivals as they arrive. */
+void window_seed(interarrival_window_t *window, double mean, double var,
+		int weight);
+
+/* Accounts the window's buffer, now and as it changes, in *bytes. */
+void window_account(interarrival_window_t *window, long *bytes);
+
+/* Number of interarrivals the window keeps at most. */
+int window_limit(interarrival_window_t *window);
+
+/* Whether the window holds size interarrivals, or as many as its limit
+ * lets it keep if that is lower, as after a memory budget shrank it. */
+int window_holds(interarrival_window_t *window, int size);
+
+/* Keeps at most limit interarrivals, the most recent ones, releasing the
+ * memory held for the others. A limit of 0 restores MAX_SIZE. */
+void window_set_limit(interarrival_window_t *window, int limit);
+
+/* Switches the window to compact storage, or back to 64 bit samples. */
+void window_set_compact(interarrival_window_t *window, int compact);
+
+/* Turns change point detection on or off. */
+void window_detect_changes(interarrival_window_t *window, int detect);
+
 #endif /* INTERARRIVAL_WINDOW_H_ */
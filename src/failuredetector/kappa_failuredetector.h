@@ -0,0 +1,47 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KAPPA_FAILUREDETECTOR_H_
+#define KAPPA_FAILUREDETECTOR_H_
+#include "failuredetector.h"
+#include "fd_opt_parser.h"
+#include "fd_memory.h"
+#include "fd_hot.h"
+
+/* Kappa accrual detector. */
+
+typedef struct {
+	fdetector_t fdetector;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
+	struct hashtable *cohorts;
+	fd_options_t options;
+	fd_budget_t budget;
+	double threshold; //kappa, in missed heartbeats, at which a monitored fails
+	double *crossing; //see accrual_kappa_crossings
+	int min_window_size;
+} kappafd_t;
+
+kappafd_t* kappafd_init(struct hashtable *params_table);
+
+/* Kappa of id at now: the sum over the heartbeats expected since the last
+ * one heard of the probability that each should have arrived, assuming
+ * normally distributed interarrivals. */
+double kappa_level(kappafd_t *this, char *id, long now);
+
+#endif /* KAPPA_FAILUREDETECTOR_H_ */
@@ -20,10 +20,371 @@
 #include "fixed_failuredetector.h"
 #include "failuredetector_factory.h"
 #include "fd_hashtable.h"
+#include "fd_perf.h"
+#include "fd_accrual.h"
+#include "fd_simulator.h"
+#include "tick_failuredetector.h"
+#include <errno.h>
+#include <math.h>
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-int main() {
+#define BENCH_ROUNDS 8
+#define BENCH_INTERVAL 1000
+#define ACCRUAL_SAMPLES 1000000
+#define CROSSING_SAMPLES 1000
+
+enum { OP_REGISTER, OP_MSG_RCV, OP_TICK, OP_IS_FAILED, OP_SHOULD_PING, OP_RELEASE, OPS };
+
+static const char *op_names[OPS] = {
+	"register", "msg_rcv", "tick", "is_failed", "should_ping", "release"
+};
+
+static const char *default_detectors[] = {
+	"fixed", "chen", "bertier", "phiaccrual", "ed", "kappa"
+};
+
+static const int bench_sizes[] = { 1000, 10000, 100000 };
+
+static void print_op(char *name, int size, int op, fd_perf_sample_t *sample,
+		long ops) {
+	int i;
+
+	printf("%-11s %7d %-12s %8.1f", name, size, op_names[op],
+			(double)sample->ns / ops);
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		if (sample->values[i] < 0) {
+			printf(" %9s", "-");
+		} else {
+			printf(" %9.2f", sample->values[i] / ops);
+		}
+	}
+	printf("\n");
+}
+
+/* Each operation is counted over one pass across all ids, visited in a
+ * shuffled order so that table and record accesses miss as they would
+ * under real session traffic, and normalised per call. */
+static int bench_detector(fd_perf_t *perf, char *name, int size) {
+	struct hashtable *params = create_fd_hashtable();
+	fdetector_t *fd = create_failure_detector(name, params);
+	char **ids;
+	int *order;
+	fd_perf_sample_t samples[OPS];
+	long counts[OPS] = { 0 };
+	long now = 0;
+	int sink = 0;
+	int i, round;
+
+	if (!fd) {
+		printf("unknown detector %s\n", name);
+		hashtable_destroy(params, 0);
+		return 0;
+	}
+	ids = malloc(size * sizeof(char*));
+	order = malloc(size * sizeof(int));
+	memset(samples, 0, sizeof(samples));
+	for (i = 0; i < size; i++) {
+		ids[i] = malloc(24);
+		sprintf(ids[i], "session-%d", i);
+		order[i] = i;
+	}
+	srand(size);
+	for (i = size - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		int t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	perf_start(perf, &samples[OP_REGISTER]);
+	for (i = 0; i < size; i++) {
+		fd->register_monitored(fd, ids[order[i]], now, 4 * BENCH_INTERVAL);
+	}
+	perf_stop(perf, &samples[OP_REGISTER]);
+	counts[OP_REGISTER] = size;
+
+	/* the last round is measured, with the windows already filled */
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		fd_perf_sample_t sample;
+
+		now += BENCH_INTERVAL;
+		for (i = 0; i < size; i++) {
+			fd->message_sent(fd, ids[order[i]], now, PING);
+		}
+		perf_start(perf, &sample);
+		for (i = 0; i < size; i++) {
+			fd->message_received(fd, ids[order[i]], now + i % 50, PING);
+		}
+		perf_stop(perf, &sample);
+		samples[OP_MSG_RCV] = sample;
+	}
+	counts[OP_MSG_RCV] = size;
+
+	/* a no-op for detectors without a tick mode */
+	perf_start(perf, &samples[OP_TICK]);
+	fd_tick(fd, now + BENCH_INTERVAL);
+	perf_stop(perf, &samples[OP_TICK]);
+	counts[OP_TICK] = size;
+
+	perf_start(perf, &samples[OP_IS_FAILED]);
+	for (i = 0; i < size; i++) {
+		sink += fd->is_failed(fd, ids[order[i]], now + BENCH_INTERVAL);
+	}
+	perf_stop(perf, &samples[OP_IS_FAILED]);
+	counts[OP_IS_FAILED] = size;
+
+	perf_start(perf, &samples[OP_SHOULD_PING]);
+	for (i = 0; i < size; i++) {
+		sink += fd->should_ping(fd, ids[order[i]], now + BENCH_INTERVAL);
+	}
+	perf_stop(perf, &samples[OP_SHOULD_PING]);
+	counts[OP_SHOULD_PING] = size;
+
+	perf_start(perf, &samples[OP_RELEASE]);
+	for (i = 0; i < size; i++) {
+		fd->release_monitored(fd, ids[order[i]]);
+	}
+	perf_stop(perf, &samples[OP_RELEASE]);
+	counts[OP_RELEASE] = size;
+	fd_destroy(fd);
+	hashtable_destroy(params, 0);
+
+	for (i = 0; i < OPS; i++) {
+		print_op(name, size, i, &samples[i], counts[i]);
+	}
+	if (sink < 0) {
+		printf("%d\n", sink);
+	}
+
+	for (i = 0; i < size; i++) {
+		free(ids[i]);
+	}
+	free(ids);
+	free(order);
+	return 1;
+}
+
+static double libm_exp_cdf(double x) {
+	return x <= 0 ? 0 : -expm1(-x);
+}
+
+static double libm_normal_cdf(double z) {
+	return 0.5 * erfc(-z / M_SQRT2);
+}
+
+/* The kappa crossing solved directly with libm, as a timeout update would
+ * without the table. */
+static double libm_kappa_crossing(double threshold, double r) {
+	double low = 0;
+	double high = threshold + 1 + ACCRUAL_NORMAL_RANGE * r;
+	int i, k;
+
+	for (i = 0; i < 60; i++) {
+		double mid = (low + high) / 2;
+		double kappa = 0;
+		for (k = 1; k < mid + ACCRUAL_NORMAL_RANGE * r; k++) {
+			kappa += r > 0 ? libm_normal_cdf((mid - k) / r) : (mid > k) + 0.5 * (mid == k);
+		}
+		if (kappa >= threshold) {
+			high = mid;
+		} else {
+			low = mid;
+		}
+	}
+	return high;
+}
+
+static void print_accrual(char *name, long n, fd_perf_sample_t *table,
+		fd_perf_sample_t *libm, double error) {
+	printf("%-16s %10.2f %10.2f %12.3g\n", name, (double)table->ns / n,
+			(double)libm->ns / n, error);
+}
+
+/* Usage: main bench accrual
+ * Speed of the accrual lookup tables against the libm functions they
+ * replace, and the largest absolute error over the sampled arguments. */
+static int bench_accrual() {
+	double *args = malloc(ACCRUAL_SAMPLES * sizeof(double));
+	double *crossing = malloc((KAPPA_STEPS + 1) * sizeof(double));
+	fd_perf_sample_t table, libm;
+	fd_perf_t perf;
+	double sink = 0, error = 0;
+	int i;
+
+	perf_open(&perf);
+	accrual_init();
+	accrual_kappa_crossings(crossing, 3);
+	srand(1);
+	printf("%-16s %10s %10s %12s\n", "function", "table ns", "libm ns", "max error");
+
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		args[i] = 40. * rand() / RAND_MAX;
+	}
+	perf_start(&perf, &table);
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		sink += accrual_exp_cdf(args[i]);
+	}
+	perf_stop(&perf, &table);
+	perf_start(&perf, &libm);
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		sink += libm_exp_cdf(args[i]);
+	}
+	perf_stop(&perf, &libm);
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		error = fmax(error, fabs(accrual_exp_cdf(args[i]) - libm_exp_cdf(args[i])));
+	}
+	print_accrual("exp cdf", ACCRUAL_SAMPLES, &table, &libm, error);
+
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		args[i] = 20. * rand() / RAND_MAX - 10;
+	}
+	perf_start(&perf, &table);
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		sink += accrual_normal_cdf(args[i]);
+	}
+	perf_stop(&perf, &table);
+	perf_start(&perf, &libm);
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		sink += libm_normal_cdf(args[i]);
+	}
+	perf_stop(&perf, &libm);
+	error = 0;
+	for (i = 0; i < ACCRUAL_SAMPLES; i++) {
+		error = fmax(error, fabs(accrual_normal_cdf(args[i]) - libm_normal_cdf(args[i])));
+	}
+	print_accrual("normal cdf", ACCRUAL_SAMPLES, &table, &libm, error);
+
+	/* error of the timeout, in expected heartbeats */
+	for (i = 0; i < CROSSING_SAMPLES; i++) {
+		args[i] = KAPPA_MAX_R * rand() / RAND_MAX;
+	}
+	perf_start(&perf, &table);
+	for (i = 0; i < CROSSING_SAMPLES; i++) {
+		sink += accrual_kappa_crossing(crossing, args[i]);
+	}
+	perf_stop(&perf, &table);
+	perf_start(&perf, &libm);
+	error = 0;
+	for (i = 0; i < CROSSING_SAMPLES; i++) {
+		double exact = libm_kappa_crossing(3, args[i]);
+		sink += exact;
+		error = fmax(error, fabs(accrual_kappa_crossing(crossing, args[i]) - exact));
+	}
+	perf_stop(&perf, &libm);
+	print_accrual("kappa timeout", CROSSING_SAMPLES, &table, &libm, error);
+
+	if (sink < 0) {
+		printf("%f\n", sink);
+	}
+	perf_close(&perf);
+	free(args);
+	free(crossing);
+	return 0;
+}
+
+/* Usage: main bench [detector...] */
+static int bench(int argc, char **argv) {
+	char **detectors = argv;
+	int count = argc;
+	fd_perf_t perf;
+	int i, j;
+
+	if (!count) {
+		detectors = (char**)default_detectors;
+		count = sizeof(default_detectors) / sizeof(*default_detectors);
+	}
+
+	if (!perf_open(&perf)) {
+		printf("# hardware counters unavailable (%s), reporting time only\n",
+				strerror(errno));
+	}
+	printf("%-11s %7s %-12s %8s", "detector", "size", "op", "ns/op");
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		printf(" %9s", perf_counter_name(i));
+	}
+	printf("\n");
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < (int)(sizeof(bench_sizes) / sizeof(*bench_sizes)); j++) {
+			if (!bench_detector(&perf, detectors[i], bench_sizes[j])) {
+				perf_close(&perf);
+				return 1;
+			}
+		}
+	}
+	perf_close(&perf);
+	return 0;
+}
+
+/* Usage: main sim [detector] [key=value...]
+ * The pairs configure both the detector and the simulation, see
+ * fd_simulator.h for the simulation keys. */
+static int sim(int argc, char **argv) {
+	struct hashtable *params = create_fd_hashtable();
+	char *name = "chen";
+	fd_sim_config_t config;
+	fd_sim_result_t result;
+	fdetector_t *fd;
+	double seconds, hours;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		char *value = strchr(argv[i], '=');
+		if (value) {
+			*value = 0;
+			fd_hashtable_insert(params, argv[i], value + 1);
+		} else {
+			name = argv[i];
+		}
+	}
+	fd = create_failure_detector(name, params);
+	if (!fd) {
+		printf("unknown detector %s\n", name);
+		hashtable_destroy(params, 0);
+		return 1;
+	}
+	default_sim_config(&config);
+	parse_sim_config(&config, params);
+	if (!run_simulation(fd, &config, &result)) {
+		printf("out of memory\n");
+	}
+	seconds = config.duration / 1000.;
+	hours = seconds / 3600 * (config.monitoreds - result.crashed / 2.);
+
+	printf("%-22s %s\n", "detector", name);
+	printf("%-22s %d over %.0f s\n", "monitoreds", config.monitoreds, seconds);
+	printf("%-22s %ld\n", "events", result.events);
+	printf("%-22s %ld sent, %ld lost\n", "heartbeats", result.heartbeats, result.lost);
+	printf("%-22s %ld of %ld crashes\n", "detected", result.detected, result.crashed);
+	printf("%-22s %.1f ms mean, %ld ms max\n", "detection time",
+			result.detection_mean, result.detection_max);
+	printf("%-22s %ld, %.4f per monitored hour\n", "mistakes", result.mistakes,
+			hours > 0 ? result.mistakes / hours : 0);
+	printf("%-22s %.1f ms mean, %.6f of the time\n", "mistake duration",
+			result.mistakes ? (double)result.mistake_time / result.mistakes : 0,
+			hours > 0 ? result.mistake_time / (hours * 3600000) : 0);
+	printf("%-22s %.3f s, %.1f us per simulated second\n", "cpu", result.cpu,
+			seconds > 0 ? result.cpu * 1e6 / seconds : 0);
+
+	fd_destroy(fd);
+	hashtable_destroy(params, 0);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	if (argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "accrual")) {
+		return bench_accrual();
+	}
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		return bench(argc - 2, argv + 2);
+	}
+	if (argc > 1 && !strcmp(argv[1], "sim")) {
+		return sim(argc - 2, argv + 2);
+	}
 
 	fdetector_t* fd = create_failure_detector("phiaccrual", create_fd_hashtable());
 
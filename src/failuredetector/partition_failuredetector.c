@@ -0,0 +1,309 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "partition_failuredetector.h"
+#include "failuredetector.h"
+#include "failuredetector_factory.h"
+#include "fd_hashtable.h"
+#include "fd_memory.h"
+#include "fd_opt_parser.h"
+#include "tick_failuredetector.h"
+#include "rtt_failuredetector.h"
+#include "../hashtable/hashtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEF_INNER "chen"
+#define DEF_WINDOW 1000l
+#define DEF_FRACTION 0.5
+#define DEF_MIN_MONITOREDS 4
+
+/* value of the entries of the ids set */
+static int registered;
+
+typedef struct {
+	partitionfd_t *this;
+	long now;
+	long overdue;
+	long horizon; //latest deadline of the monitoreds
+} overdue_count_t;
+
+static long deadline_of(partitionfd_t *this, char *id, long now) {
+	return now - this->inner->get_idle_time(this->inner, id, now)
+			+ this->inner->get_timeout(this->inner, id);
+}
+
+static void count_overdue(char *id, void *value, void *arg) {
+	overdue_count_t *count = arg;
+	long deadline = deadline_of(count->this, id, count->now);
+
+	if (count->this->inner->is_failed(count->this->inner, id, count->now)) {
+		count->overdue++;
+	}
+	if (deadline > count->horizon) {
+		count->horizon = deadline;
+	}
+}
+
+/* Counts the overdue monitoreds at most once per window of silence, so
+ * that the O(n) pass is only paid while nothing is heard. A count taken
+ * once every monitored's deadline passed that still finds too few of
+ * them overdue rules a partition out for the rest of this silence. */
+static int suspect_partition(partitionfd_t *this, long now) {
+	overdue_count_t count = { this, now, 0, 0 };
+	unsigned int monitoreds = hashtable_count(this->ids);
+
+	if (this->suspected) {
+		return 1;
+	}
+	if (now - this->last_heard < this->window
+			|| now - this->last_count < this->window
+			|| monitoreds < (unsigned int)this->min_monitoreds) {
+		return 0;
+	}
+	this->last_count = now;
+	fd_hashtable_foreach(this->ids, count_overdue, &count);
+	if (count.overdue >= this->fraction * monitoreds) {
+		this->suspected = 1;
+		this->since = this->last_heard;
+	} else if (now >= count.horizon) {
+		this->cleared = this->last_heard;
+	}
+	return this->suspected;
+}
+
+static void heard(partitionfd_t *this, long now) {
+	if (now > this->last_heard) {
+		this->last_heard = now;
+	}
+}
+
+static void add_id(partitionfd_t *this, char *id) {
+	if (!hashtable_search(this->ids, id)) {
+		fd_hashtable_insert(this->ids, id, &registered);
+	}
+}
+
+void partition_reg_monitored(partitionfd_t *this, char *id, long now,
+		long timeout) {
+	this->inner->register_monitored(this->inner, id, now, timeout);
+	add_id(this, id);
+	heard(this, now);
+}
+
+void partition_reg_in_cohort(partitionfd_t *this, char *id, char *group,
+		long now, long timeout) {
+	this->inner->register_in_cohort(this->inner, id, group, now, timeout);
+	add_id(this, id);
+	heard(this, now);
+}
+
+void partition_reg_many(partitionfd_t *this, char **ids, int count, long now,
+		long timeout) {
+	int i;
+
+	this->inner->register_many(this->inner, ids, count, now, timeout);
+	hashtable_reserve(this->ids, hashtable_count(this->ids) + count);
+	for (i = 0; i < count; i++) {
+		add_id(this, ids[i]);
+	}
+	heard(this, now);
+}
+
+void partition_release(partitionfd_t *this, char *id) {
+	hashtable_remove(this->ids, id);
+	this->inner->release_monitored(this->inner, id);
+}
+
+void partition_release_many(partitionfd_t *this, char **ids, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		hashtable_remove(this->ids, ids[i]);
+	}
+	this->inner->release_many(this->inner, ids, count);
+}
+
+/* Any message shows the network is back. */
+void partition_msg_rcv(partitionfd_t *this, char *id, long now, int type) {
+	this->inner->message_received(this->inner, id, now, type);
+	heard(this, now);
+	if (this->suspected) {
+		this->suspected = 0;
+		this->ended = now;
+	}
+}
+
+void partition_msg_sent(partitionfd_t *this, char *id, long now, int type) {
+	this->inner->message_sent(this->inner, id, now, type);
+}
+
+/* A suspicion is reported once something was heard after the deadline,
+ * or a count ruled a partition out for the silence it fell in. */
+int partition_failed(partitionfd_t *this, char *id, long now) {
+	if (!this->inner->is_failed(this->inner, id, now)
+			|| suspect_partition(this, now)) {
+		return 0;
+	}
+	if (this->last_heard <= deadline_of(this, id, now)
+			&& this->cleared != this->last_heard
+			&& hashtable_count(this->ids) >= (unsigned int)this->min_monitoreds) {
+		return 0;
+	}
+	return !this->ended
+			|| now - this->ended > this->inner->get_timeout(this->inner, id);
+}
+
+int partition_partitioned(partitionfd_t *this, long now, long *since) {
+	if (!suspect_partition(this, now)) {
+		return 0;
+	}
+	if (since) {
+		*since = this->since;
+	}
+	return 1;
+}
+
+int fd_partitioned(fdetector_t *fd, long now, long *since) {
+	return fd->partitioned ? fd->partitioned(fd, now, since) : -1;
+}
+
+int partition_should_ping(partitionfd_t *this, char *id, long now) {
+	return this->inner->should_ping(this->inner, id, now);
+}
+
+void partition_set_to(partitionfd_t *this, char *id, long timeout) {
+	this->inner->set_timeout(this->inner, id, timeout);
+}
+
+long partition_get_to(partitionfd_t *this, char *id) {
+	return this->inner->get_timeout(this->inner, id);
+}
+
+void partition_set_ping_interval(partitionfd_t *this, char *id, long interval) {
+	this->inner->set_ping_interval(this->inner, id, interval);
+}
+
+long partition_get_idle(partitionfd_t *this, char *id, long now) {
+	return this->inner->get_idle_time(this->inner, id, now);
+}
+
+long partition_time_next_ping(partitionfd_t *this, char *id, long now) {
+	return this->inner->get_time_to_next_ping(this->inner, id, now);
+}
+
+long partition_get_rtt(partitionfd_t *this, char *id) {
+	return fd_get_rtt(this->inner, id);
+}
+
+void partition_tick(partitionfd_t *this, long now) {
+	fd_tick(this->inner, now);
+}
+
+void partition_export_states(partitionfd_t *this, fd_state_visitor_t *visitor) {
+	this->inner->export_states(this->inner, visitor);
+}
+
+void partition_import_state(partitionfd_t *this, fd_state_t *state) {
+	this->inner->import_state(this->inner, state);
+	add_id(this, state->id);
+	heard(this, state->last_heard);
+}
+
+void partition_memory_usage(partitionfd_t *this, fd_memory_t *usage) {
+	fd_memory_usage(this->inner, usage);
+	memory_add_table(usage, this->ids);
+	memory_total(usage);
+}
+
+static void parse_partition(partitionfd_t *this, struct hashtable *params_table) {
+	this->window = parse_long(this->window,
+			hashtable_search(params_table, "partitionwindow"));
+	this->fraction = parse_double(this->fraction,
+			hashtable_search(params_table, "partitionfraction"));
+	this->min_monitoreds = parse_int(this->min_monitoreds,
+			hashtable_search(params_table, "partitionmin"));
+}
+
+void partition_reconfigure(partitionfd_t *this, struct hashtable *params_table) {
+	fd_reconfigure(this->inner, params_table);
+	parse_partition(this, params_table);
+}
+
+void partition_destroy(partitionfd_t *this) {
+	fd_destroy(this->inner);
+	hashtable_destroy(this->ids, 0);
+	free(this);
+}
+
+partitionfd_t* partitionfd_init_params(char *inner_name,
+		struct hashtable *params_table) {
+	partitionfd_t *p_fd;
+	fdetector_t *inner;
+
+	if (strcmp(inner_name, "partition") == 0) {
+		return NULL;
+	}
+	inner = create_failure_detector(inner_name, params_table);
+	if (!inner) {
+		return NULL;
+	}
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)partition_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)partition_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)partition_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)partition_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)partition_set_to;
+	p_fd->fdetector.get_timeout = (void*)partition_get_to;
+	p_fd->fdetector.is_failed = (void*)partition_failed;
+	p_fd->fdetector.get_idle_time = (void*)partition_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)partition_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)partition_should_ping;
+	p_fd->fdetector.release_monitored = (void*)partition_release;
+	p_fd->fdetector.register_many = (void*)partition_reg_many;
+	p_fd->fdetector.release_many = (void*)partition_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)partition_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)partition_export_states;
+	p_fd->fdetector.import_state = (void*)partition_import_state;
+	p_fd->fdetector.memory_usage = (void*)partition_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)partition_reconfigure;
+	p_fd->fdetector.destroy = (void*)partition_destroy;
+	p_fd->fdetector.partitioned = (void*)partition_partitioned;
+	if (inner->get_rtt) {
+		p_fd->fdetector.get_rtt = (void*)partition_get_rtt;
+	}
+	if (inner->tick) {
+		p_fd->fdetector.tick = (void*)partition_tick;
+	}
+
+	p_fd->inner = inner;
+	p_fd->ids = create_fd_hashtable();
+	p_fd->cleared = -1;
+	p_fd->window = DEF_WINDOW;
+	p_fd->fraction = DEF_FRACTION;
+	p_fd->min_monitoreds = DEF_MIN_MONITOREDS;
+	parse_partition(p_fd, params_table);
+	return p_fd;
+}
+
+partitionfd_t* partitionfd_init(struct hashtable *params_table) {
+	char *inner = hashtable_search(params_table, "inner");
+	return partitionfd_init_params(inner ? inner : DEF_INNER, params_table);
+}
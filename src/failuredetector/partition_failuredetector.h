@@ -0,0 +1,65 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARTITION_FAILUREDETECTOR_H_
+#define PARTITION_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+/* Wraps an inner detector, telling a local partition apart from failures
+ * of the monitoreds. When this host loses the network every monitored
+ * crosses its deadline together, and nothing is heard from any of them:
+ * a suspicion is held back until either a message from any monitored
+ * arrives after its deadline, showing the network still works, or a
+ * count rules a partition out. A window of silence makes the wrapper
+ * count the overdue monitoreds once, and if they are a large enough
+ * fraction it suspects a local partition instead, a single event read
+ * with fd_partitioned, deferring every suspicion; a count taken after
+ * every monitored's deadline that finds fewer releases them instead. The
+ * next message ends the partition, and suspicions stay deferred for one
+ * more timeout, so that the monitoreds are heard from again rather than
+ * reconnected to. */
+typedef struct {
+	fdetector_t fdetector;
+	fdetector_t *inner;
+	struct hashtable *ids; //set of the registered monitoreds
+
+	long last_heard; //from any monitored
+	long since; //start of the silence a partition is suspected in
+	int suspected; //a local partition
+	long ended; //time the last partition ended, 0 if none
+	long last_count; //of the overdue monitoreds
+	long cleared; //last_heard when a count ruled a partition out, -1 if none
+
+	long window; //ms of silence before a partition is suspected
+	double fraction; //of monitoreds overdue, for a partition
+	int min_monitoreds; //fewer cannot make a partition
+} partitionfd_t;
+
+partitionfd_t* partitionfd_init(struct hashtable *params_table);
+
+partitionfd_t* partitionfd_init_params(char *inner_name,
+		struct hashtable *params_table);
+
+/* Returns 1 if a local partition is suspected at now, setting since to
+ * the time nothing has been heard from any monitored since, 0 if not,
+ * or -1 if fd does not detect partitions. */
+int fd_partitioned(fdetector_t *fd, long now, long *since);
+
+#endif /* PARTITION_FAILUREDETECTOR_H_ */
@@ -19,10 +19,17 @@
 #ifndef PHIACCRUAL_FAILUREDETECTOR_H_
 #define PHIACCRUAL_FAILUREDETECTOR_H_
 #include "failuredetector.h"
+#include "fd_opt_parser.h"
+#include "fd_memory.h"
+#include "fd_hot.h"
 
 typedef struct {
 	fdetector_t fdetector;
-	struct hashtable *monitoreds;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
+	struct hashtable *cohorts;
+	fd_options_t options;
+	fd_budget_t budget;
 	double threshold;
 	int min_window_size;
 } phiaccrualfd_t;
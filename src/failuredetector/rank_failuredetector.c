@@ -0,0 +1,549 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rank_failuredetector.h"
+#include "failuredetector.h"
+#include "failuredetector_factory.h"
+#include "fd_hashtable.h"
+#include "fd_memory.h"
+#include "fd_opt_parser.h"
+#include "tick_failuredetector.h"
+#include "../hashtable/hashtable.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEF_INNER "chen"
+#define DEF_LATENCY_WEIGHT 1.
+#define DEF_JITTER_WEIGHT 1.
+#define DEF_SUSPICION_WEIGHT 1000.
+#define DEF_HALF_LIFE 600000l
+#define MIN_CAPACITY 16
+
+/* The round trip is kept scaled by 8, and the interarrival mean and mean
+ * deviation by 8 and 4, with gains of 1/8 and 1/4 as in RFC 6298. */
+typedef struct rank_entry {
+	char *id; //owned by the entries table
+	int index; //position in the heap
+	int suspected; //since the last message
+	int outstanding; //pings sent since the last reply
+	long ping_sent;
+	long last_ping;
+	long rtt;
+	long mean;
+	long jitter;
+	double suspicions; //decayed count, as of suspected_at
+	long suspected_at;
+	double score;
+} rank_entry_t;
+
+static int grow(rankfd_t *this, int count) {
+	int capacity = this->capacity ? this->capacity : MIN_CAPACITY;
+	void *p;
+
+	if (count <= this->capacity) {
+		return 1;
+	}
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	if (!(p = realloc(this->heap, capacity * sizeof(*this->heap)))) {
+		return 0;
+	}
+	this->heap = p;
+	if (!(p = realloc(this->candidates, capacity * sizeof(*this->candidates)))) {
+		return 0;
+	}
+	this->candidates = p;
+	this->capacity = capacity;
+	return 1;
+}
+
+static double suspicions(rankfd_t *this, rank_entry_t *e, long now) {
+	if (!e->suspicions || this->half_life <= 0 || now <= e->suspected_at) {
+		return e->suspicions;
+	}
+	return e->suspicions * exp2(-(double)(now - e->suspected_at) / this->half_life);
+}
+
+static double score(rankfd_t *this, rank_entry_t *e, long now) {
+	return this->latency_weight * e->rtt / 8 + this->jitter_weight * e->jitter / 4
+			+ this->suspicion_weight * suspicions(this, e, now);
+}
+
+static void place(rankfd_t *this, rank_entry_t *e, int index) {
+	this->heap[index] = e;
+	e->index = index;
+}
+
+static void sift_up(rankfd_t *this, int index) {
+	rank_entry_t *e = this->heap[index];
+
+	while (index > 0 && e->score < this->heap[(index - 1) / 2]->score) {
+		place(this, this->heap[(index - 1) / 2], index);
+		index = (index - 1) / 2;
+	}
+	place(this, e, index);
+}
+
+static void sift_down(rankfd_t *this, int index) {
+	rank_entry_t *e = this->heap[index];
+
+	for (;;) {
+		int child = 2 * index + 1;
+
+		if (child >= this->count) {
+			break;
+		}
+		if (child + 1 < this->count
+				&& this->heap[child + 1]->score < this->heap[child]->score) {
+			child++;
+		}
+		if (this->heap[child]->score >= e->score) {
+			break;
+		}
+		place(this, this->heap[child], index);
+		index = child;
+	}
+	place(this, e, index);
+}
+
+static void rescore(rankfd_t *this, rank_entry_t *e, long now) {
+	e->score = score(this, e, now);
+	sift_up(this, e->index);
+	sift_down(this, e->index);
+}
+
+static rank_entry_t* add_entry(rankfd_t *this, char *id) {
+	rank_entry_t *e = hashtable_search(this->entries, id);
+
+	if (e) {
+		return e;
+	}
+	if (!grow(this, this->count + 1)) {
+		return NULL;
+	}
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		return NULL;
+	}
+	place(this, e, this->count++);
+	sift_up(this, e->index);
+	e->id = fd_hashtable_insert(this->entries, id, e);
+	return e;
+}
+
+/* Moves the last heap entry into the released one's place. */
+static void remove_entry(rankfd_t *this, char *id) {
+	rank_entry_t *e = hashtable_remove(this->entries, id);
+	rank_entry_t *last;
+
+	if (!e) {
+		return;
+	}
+	last = this->heap[--this->count];
+	if (last != e) {
+		place(this, last, e->index);
+		sift_up(this, last->index);
+		sift_down(this, last->index);
+	}
+	free(e);
+}
+
+static void add_rtt(rank_entry_t *e, long rtt) {
+	long delta;
+
+	if (!e->rtt) {
+		e->rtt = (rtt << 3) | 1;
+		return;
+	}
+	delta = rtt - (e->rtt >> 3);
+	e->rtt += delta;
+	if (e->rtt <= 0) {
+		e->rtt = 1;
+	}
+}
+
+static void add_interarrival(rank_entry_t *e, long interarrival) {
+	long delta;
+
+	if (!e->mean) {
+		e->mean = interarrival << 3;
+		return;
+	}
+	delta = interarrival - (e->mean >> 3);
+	e->mean += delta;
+	if (delta < 0) {
+		delta = -delta;
+	}
+	e->jitter += delta - (e->jitter >> 2);
+}
+
+/* Adds the entry of an id the inner detector just registered. Out of
+ * memory, the id is released from the inner detector again, so that it
+ * is registered in both or in neither. */
+static rank_entry_t* track(rankfd_t *this, char *id) {
+	rank_entry_t *e = add_entry(this, id);
+
+	if (!e) {
+		this->inner->release_monitored(this->inner, id);
+	}
+	return e;
+}
+
+void rank_reg_monitored(rankfd_t *this, char *id, long now, long timeout) {
+	this->inner->register_monitored(this->inner, id, now, timeout);
+	track(this, id);
+}
+
+void rank_reg_in_cohort(rankfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	this->inner->register_in_cohort(this->inner, id, group, now, timeout);
+	track(this, id);
+}
+
+void rank_reg_many(rankfd_t *this, char **ids, int count, long now,
+		long timeout) {
+	int i;
+
+	this->inner->register_many(this->inner, ids, count, now, timeout);
+	hashtable_reserve(this->entries, hashtable_count(this->entries) + count);
+	if (!grow(this, this->count + count)) {
+		for (i = 0; i < count; i++) {
+			if (!hashtable_search(this->entries, ids[i])) {
+				this->inner->release_monitored(this->inner, ids[i]);
+			}
+		}
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		track(this, ids[i]);
+	}
+}
+
+void rank_release(rankfd_t *this, char *id) {
+	remove_entry(this, id);
+	this->inner->release_monitored(this->inner, id);
+}
+
+void rank_release_many(rankfd_t *this, char **ids, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		remove_entry(this, ids[i]);
+	}
+	this->inner->release_many(this->inner, ids, count);
+}
+
+void rank_msg_rcv(rankfd_t *this, char *id, long now, int type) {
+	rank_entry_t *e = hashtable_search(this->entries, id);
+
+	this->inner->message_received(this->inner, id, now, type);
+	if (type == PING) {
+		/* as in the rtt detector, replies to repeated pings are not sampled */
+		if (e->outstanding == 1 && now >= e->ping_sent) {
+			add_rtt(e, now - e->ping_sent);
+		}
+		e->outstanding = 0;
+		if (e->last_ping && now > e->last_ping) {
+			add_interarrival(e, now - e->last_ping);
+		}
+		e->last_ping = now;
+	}
+	e->suspected = 0;
+	rescore(this, e, now);
+}
+
+void rank_msg_sent(rankfd_t *this, char *id, long now, int type) {
+	rank_entry_t *e = hashtable_search(this->entries, id);
+
+	this->inner->message_sent(this->inner, id, now, type);
+	if (type == PING && !e->outstanding++) {
+		e->ping_sent = now;
+	}
+}
+
+/* A suspicion counts once, until the monitored is heard from again. */
+int rank_failed(rankfd_t *this, char *id, long now) {
+	int failed = this->inner->is_failed(this->inner, id, now);
+	rank_entry_t *e;
+
+	if (failed && !(e = hashtable_search(this->entries, id))->suspected) {
+		e->suspicions = suspicions(this, e, now) + 1;
+		e->suspected_at = now;
+		e->suspected = 1;
+		rescore(this, e, now);
+	}
+	return failed;
+}
+
+int rank_should_ping(rankfd_t *this, char *id, long now) {
+	return this->inner->should_ping(this->inner, id, now);
+}
+
+void rank_set_to(rankfd_t *this, char *id, long timeout) {
+	this->inner->set_timeout(this->inner, id, timeout);
+}
+
+long rank_get_to(rankfd_t *this, char *id) {
+	return this->inner->get_timeout(this->inner, id);
+}
+
+void rank_set_ping_interval(rankfd_t *this, char *id, long interval) {
+	this->inner->set_ping_interval(this->inner, id, interval);
+}
+
+long rank_get_idle(rankfd_t *this, char *id, long now) {
+	return this->inner->get_idle_time(this->inner, id, now);
+}
+
+long rank_time_next_ping(rankfd_t *this, char *id, long now) {
+	return this->inner->get_time_to_next_ping(this->inner, id, now);
+}
+
+long rank_get_rtt(rankfd_t *this, char *id) {
+	rank_entry_t *e = hashtable_search(this->entries, id);
+	return e && e->rtt ? e->rtt >> 3 : -1;
+}
+
+void rank_tick(rankfd_t *this, long now) {
+	fd_tick(this->inner, now);
+}
+
+static int candidate_before(rankfd_t *this, int a, int b) {
+	return this->heap[this->candidates[a]]->score
+			< this->heap[this->candidates[b]]->score;
+}
+
+static void push_candidate(rankfd_t *this, int *count, int index) {
+	int i = (*count)++;
+
+	this->candidates[i] = index;
+	while (i > 0 && candidate_before(this, i, (i - 1) / 2)) {
+		int parent = this->candidates[(i - 1) / 2];
+		this->candidates[(i - 1) / 2] = this->candidates[i];
+		this->candidates[i] = parent;
+		i = (i - 1) / 2;
+	}
+}
+
+static int pop_candidate(rankfd_t *this, int *count) {
+	int top = this->candidates[0];
+	int i = 0;
+
+	this->candidates[0] = this->candidates[--*count];
+	for (;;) {
+		int child = 2 * i + 1;
+		int swap;
+
+		if (child >= *count) {
+			break;
+		}
+		if (child + 1 < *count && candidate_before(this, child + 1, child)) {
+			child++;
+		}
+		if (!candidate_before(this, child, i)) {
+			break;
+		}
+		swap = this->candidates[i];
+		this->candidates[i] = this->candidates[child];
+		this->candidates[child] = swap;
+		i = child;
+	}
+	return top;
+}
+
+/* Walks the score heap best first through a heap of candidate positions,
+ * each visited entry adding its two children, so k entries cost O(k log k).
+ * Suspected entries are set aside at the end of best, worst last, and
+ * moved up behind the healthy ones once the walk is over. */
+int rank_rank(rankfd_t *this, long now, char **best, int k) {
+	int candidates = 0;
+	int healthy = 0;
+	int suspected = 0;
+
+	if (this->count && k > 0) {
+		push_candidate(this, &candidates, 0);
+	}
+	while (candidates && healthy < k) {
+		int index = pop_candidate(this, &candidates);
+		rank_entry_t *e = this->heap[index];
+
+		if (2 * index + 1 < this->count) {
+			push_candidate(this, &candidates, 2 * index + 1);
+		}
+		if (2 * index + 2 < this->count) {
+			push_candidate(this, &candidates, 2 * index + 2);
+		}
+		if (!this->inner->is_failed(this->inner, e->id, now)) {
+			if (healthy + suspected == k) {
+				suspected--;
+			}
+			best[healthy++] = e->id;
+		} else if (healthy + suspected < k) {
+			best[k - 1 - suspected++] = e->id;
+		}
+	}
+	if (suspected) {
+		int i;
+
+		for (i = 0; i < suspected / 2; i++) {
+			char *swap = best[k - suspected + i];
+			best[k - suspected + i] = best[k - 1 - i];
+			best[k - 1 - i] = swap;
+		}
+		memmove(best + healthy, best + k - suspected, suspected * sizeof(*best));
+	}
+	return healthy + suspected;
+}
+
+int fd_rank(fdetector_t *fd, long now, char **best, int k) {
+	return fd->rank ? fd->rank(fd, now, best, k) : -1;
+}
+
+typedef struct {
+	fd_state_visitor_t visitor;
+	rankfd_t *this;
+	fd_state_visitor_t *outer;
+} rank_visitor_t;
+
+/* Adds the ranking's round trip to states whose inner detector does not
+ * measure one. */
+static void visit_state(fd_state_visitor_t *visitor, fd_state_t *state) {
+	rank_visitor_t *v = (rank_visitor_t*) visitor;
+	rank_entry_t *e = hashtable_search(v->this->entries, state->id);
+	fd_state_t copy = *state;
+
+	if (!copy.srtt && e) {
+		copy.srtt = e->rtt;
+	}
+	v->outer->visit(v->outer, &copy);
+}
+
+void rank_export_states(rankfd_t *this, fd_state_visitor_t *visitor) {
+	rank_visitor_t v = { { visit_state }, this, visitor };
+
+	this->inner->export_states(this->inner, &v.visitor);
+}
+
+void rank_import_state(rankfd_t *this, fd_state_t *state) {
+	rank_entry_t *e;
+
+	this->inner->import_state(this->inner, state);
+	if ((e = track(this, state->id)) && state->srtt > 0) {
+		e->rtt = state->srtt;
+		rescore(this, e, state->last_heard);
+	}
+}
+
+/* The inner detector's usage, plus the entries and the heaps. */
+void rank_memory_usage(rankfd_t *this, fd_memory_t *usage) {
+	fd_memory_usage(this->inner, usage);
+	memory_add_table(usage, this->entries);
+	usage->records += this->count * sizeof(rank_entry_t)
+			+ this->capacity * (sizeof(*this->heap) + sizeof(*this->candidates));
+	memory_total(usage);
+}
+
+static void parse_weights(rankfd_t *this, struct hashtable *params_table) {
+	this->latency_weight = parse_double(this->latency_weight,
+			hashtable_search(params_table, "latencyweight"));
+	this->jitter_weight = parse_double(this->jitter_weight,
+			hashtable_search(params_table, "jitterweight"));
+	this->suspicion_weight = parse_double(this->suspicion_weight,
+			hashtable_search(params_table, "suspicionweight"));
+	this->half_life = parse_long(this->half_life,
+			hashtable_search(params_table, "halflife"));
+}
+
+/* Rescores every entry with the new weights, as of its last suspicion,
+ * and rebuilds the heap. */
+void rank_reconfigure(rankfd_t *this, struct hashtable *params_table) {
+	int i;
+
+	fd_reconfigure(this->inner, params_table);
+	parse_weights(this, params_table);
+	for (i = 0; i < this->count; i++) {
+		this->heap[i]->score = score(this, this->heap[i], this->heap[i]->suspected_at);
+	}
+	for (i = this->count / 2 - 1; i >= 0; i--) {
+		sift_down(this, i);
+	}
+}
+
+void rank_destroy(rankfd_t *this) {
+	fd_destroy(this->inner);
+	hashtable_destroy(this->entries, 1);
+	free(this->heap);
+	free(this->candidates);
+	free(this);
+}
+
+rankfd_t* rankfd_init_params(char *inner_name, struct hashtable *params_table) {
+	rankfd_t *p_fd;
+	fdetector_t *inner;
+
+	if (strcmp(inner_name, "rank") == 0) {
+		return NULL;
+	}
+	inner = create_failure_detector(inner_name, params_table);
+	if (!inner) {
+		return NULL;
+	}
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)rank_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)rank_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)rank_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)rank_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)rank_set_to;
+	p_fd->fdetector.get_timeout = (void*)rank_get_to;
+	p_fd->fdetector.is_failed = (void*)rank_failed;
+	p_fd->fdetector.get_idle_time = (void*)rank_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)rank_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)rank_should_ping;
+	p_fd->fdetector.release_monitored = (void*)rank_release;
+	p_fd->fdetector.register_many = (void*)rank_reg_many;
+	p_fd->fdetector.release_many = (void*)rank_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)rank_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)rank_export_states;
+	p_fd->fdetector.import_state = (void*)rank_import_state;
+	p_fd->fdetector.memory_usage = (void*)rank_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)rank_reconfigure;
+	p_fd->fdetector.destroy = (void*)rank_destroy;
+	p_fd->fdetector.get_rtt = (void*)rank_get_rtt;
+	p_fd->fdetector.rank = (void*)rank_rank;
+	if (inner->tick) {
+		p_fd->fdetector.tick = (void*)rank_tick;
+	}
+
+	p_fd->inner = inner;
+	p_fd->entries = create_fd_hashtable();
+	p_fd->latency_weight = DEF_LATENCY_WEIGHT;
+	p_fd->jitter_weight = DEF_JITTER_WEIGHT;
+	p_fd->suspicion_weight = DEF_SUSPICION_WEIGHT;
+	p_fd->half_life = DEF_HALF_LIFE;
+	parse_weights(p_fd, params_table);
+	return p_fd;
+}
+
+rankfd_t* rankfd_init(struct hashtable *params_table) {
+	char *inner = hashtable_search(params_table, "inner");
+	return rankfd_init_params(inner ? inner : DEF_INNER, params_table);
+}
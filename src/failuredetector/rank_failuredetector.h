@@ -0,0 +1,58 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RANK_FAILUREDETECTOR_H_
+#define RANK_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+struct rank_entry;
+
+/* Wraps an inner detector, scoring each monitored's health from the
+ * traffic passing through: ping round trip, interarrival jitter and the
+ * suspicions of the last half lives, all weighted into milliseconds. The
+ * scores are kept in a heap updated on every message, so that fd_rank
+ * reads the k healthiest monitoreds in O(k log k), to pick which server
+ * to fail over to. */
+typedef struct {
+	fdetector_t fdetector;
+	fdetector_t *inner;
+	struct hashtable *entries;
+	struct rank_entry **heap; //lowest score, the healthiest, first
+	int *candidates; //scratch heap of heap positions for fd_rank
+	int count;
+	int capacity;
+
+	double latency_weight;
+	double jitter_weight;
+	double suspicion_weight; //ms a suspicion costs
+	long half_life; //of a suspicion's weight
+} rankfd_t;
+
+rankfd_t* rankfd_init(struct hashtable *params_table);
+
+rankfd_t* rankfd_init_params(char *inner_name, struct hashtable *params_table);
+
+/* Fills best with up to k of fd's monitoreds, healthiest first, and
+ * returns how many. Monitoreds suspected at now come after all the
+ * others. The ids are fd's own, valid until released. Returns -1 if fd
+ * does not rank its monitoreds. */
+int fd_rank(fdetector_t *fd, long now, char **best, int k);
+
+#endif /* RANK_FAILUREDETECTOR_H_ */
@@ -0,0 +1,328 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rtt_failuredetector.h"
+#include "failuredetector.h"
+#include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_hot.h"
+#include "fd_memory.h"
+#include "fd_opt_parser.h"
+#include "../hashtable/hashtable.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define DEF_K 4l
+/* SRTT is kept scaled by 8 and RTTVAR by 4, so that the gains of 1/8 and
+ * 1/4 are shifts */
+#define SRTT_SHIFT 3
+#define RTTVAR_SHIFT 2
+
+typedef struct {
+	char* id;
+	fd_hot_t *hot; //what queries read
+	fd_batch_t *batch; //block the record was bulk allocated in, if any
+	long ping_sent; //oldest ping awaiting its reply
+	int outstanding; //pings sent since the last reply
+	long srtt; //scaled, 0 before the first reply
+	long rttvar; //scaled
+} monitored_t;
+
+static monitored_t* lookup(rttfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot ? hot->cold : NULL;
+}
+
+static int init_monitored(rttfd_t *this, monitored_t *m, long now, long timeout) {
+	m->hot = hot_alloc(&this->hot, m);
+	if (!m->hot) {
+		return 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+	hot_set_last_sent(&this->hot, m->hot, now);
+	hot_set_to(&this->hot, m->hot, timeout);
+	hot_set_eta(&this->hot, m->hot, timeout / 2);
+	return 1;
+}
+
+static void update_timeout(rttfd_t *this, monitored_t *m) {
+	if (m->srtt) {
+		hot_set_to(&this->hot, m->hot, hot_eta(&this->hot, m->hot)
+				+ (m->srtt >> SRTT_SHIFT) + ((this->k * m->rttvar) >> RTTVAR_SHIFT));
+	}
+}
+
+/* RFC 6298, with the first sample setting SRTT to it and RTTVAR to half
+ * of it. */
+static void add_rtt(rttfd_t *this, monitored_t *m, long rtt) {
+	if (!m->srtt) {
+		m->srtt = (rtt << SRTT_SHIFT) | 1;
+		m->rttvar = rtt << (RTTVAR_SHIFT - 1);
+	} else {
+		long delta = rtt - (m->srtt >> SRTT_SHIFT);
+
+		m->srtt += delta;
+		if (m->srtt <= 0) {
+			m->srtt = 1;
+		}
+		if (delta < 0) {
+			delta = -delta;
+		}
+		m->rttvar += delta - (m->rttvar >> RTTVAR_SHIFT);
+	}
+	update_timeout(this, m);
+}
+
+void rtt_reg_monitored(rttfd_t *this, char *id, long now, long timeout) {
+	monitored_t *m;
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return;
+	}
+
+	if (!init_monitored(this, m, now, timeout)) {
+		free(m);
+		return;
+	}
+	m->id = fd_hashtable_insert(this->monitoreds, id, m->hot);
+}
+
+void rtt_reg_in_cohort(rttfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	rtt_reg_monitored(this, id, now, timeout);
+}
+
+void rtt_set_to(rttfd_t *this, char *id, long timeout) {
+	monitored_t* m = lookup(this, id);
+	hot_set_to(&this->hot, m->hot, timeout);
+}
+
+long rtt_get_to(rttfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_to(&this->hot, hot);
+}
+
+void rtt_msg_rcv(rttfd_t *this, char *id, long now, int type) {
+	monitored_t* m = lookup(this, id);
+
+	if (type == PING && m->outstanding) {
+		/* Karn: a reply to one of several pings has no known round trip */
+		if (m->outstanding == 1 && now >= m->ping_sent) {
+			add_rtt(this, m, now - m->ping_sent);
+		}
+		m->outstanding = 0;
+	}
+	hot_set_last_heard(&this->hot, m->hot, now);
+}
+
+void rtt_msg_sent(rttfd_t *this, char *id, long now, int type) {
+	monitored_t* m = lookup(this, id);
+
+	if (type == PING && !m->outstanding++) {
+		m->ping_sent = now;
+	}
+	hot_set_last_sent(&this->hot, m->hot, now);
+}
+
+int rtt_failed(rttfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now > hot_last_heard(&this->hot, hot) + hot_to(&this->hot, hot);
+}
+
+long rtt_get_idle(rttfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return now - hot_last_heard(&this->hot, hot);
+}
+
+long rtt_time_next_ping(rttfd_t *this, char *id, long now) {
+	fd_hot_t *hot = hashtable_search(this->monitoreds, id);
+	return hot_eta(&this->hot, hot) - (now - hot_last_sent(&this->hot, hot));
+}
+
+int rtt_should_ping(rttfd_t *this, char *id, long now) {
+	return rtt_time_next_ping(this, id, now) <= 0;
+}
+
+long rtt_get_rtt(rttfd_t *this, char *id) {
+	monitored_t* m = lookup(this, id);
+	return m && m->srtt ? m->srtt >> SRTT_SHIFT : -1;
+}
+
+long fd_get_rtt(fdetector_t *fd, char *id) {
+	return fd->get_rtt ? fd->get_rtt(fd, id) : -1;
+}
+
+static void destroy_monitored(monitored_t *m) {
+	if (m->batch) {
+		batch_release(m->batch);
+	} else {
+		free(m);
+	}
+}
+
+void rtt_release(rttfd_t *this, char *id) {
+	fd_hot_t *hot = hashtable_remove(this->monitoreds, id);
+	monitored_t *m = hot->cold;
+
+	hot_free(&this->hot, hot);
+	destroy_monitored(m);
+}
+
+void rtt_reg_many(rttfd_t *this, char **ids, int count, long now, long timeout) {
+	fd_batch_t *batch;
+	monitored_t *ms;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+	hashtable_reserve(this->monitoreds, hashtable_count(this->monitoreds) + count);
+
+	ms = batch_alloc(&batch, count, sizeof(*ms));
+	if (!ms) {
+		for (i = 0; i < count; i++) {
+			rtt_reg_monitored(this, ids[i], now, timeout);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		monitored_t *m = &ms[i];
+
+		m->batch = batch;
+		if (!init_monitored(this, m, now, timeout)) {
+			batch_release(batch);
+			continue;
+		}
+		m->id = fd_hashtable_insert(this->monitoreds, ids[i], m->hot);
+	}
+}
+
+void rtt_release_many(rttfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		rtt_release(this, ids[i]);
+	}
+}
+
+void rtt_set_ping_interval(rttfd_t *this, char *id, long interval) {
+	monitored_t* m = lookup(this, id);
+	hot_set_eta(&this->hot, m->hot, interval);
+	update_timeout(this, m);
+}
+
+static void export_monitored(char *id, void *value, void *arg) {
+	hot_export_t *export = arg;
+	monitored_t *m = ((fd_hot_t*) value)->cold;
+	fd_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	hot_export(export->pool, m->hot, &state);
+	state.srtt = m->srtt;
+	state.rttvar = m->rttvar;
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void rtt_export_states(rttfd_t *this, fd_state_visitor_t *visitor) {
+	hot_export_t export = { &this->hot, visitor };
+
+	fd_hashtable_foreach(this->monitoreds, export_monitored, &export);
+}
+
+void rtt_import_state(rttfd_t *this, fd_state_t *state) {
+	monitored_t* m = lookup(this, state->id);
+	if (!m) {
+		rtt_reg_monitored(this, state->id, state->last_heard, state->timeout);
+		m = lookup(this, state->id);
+		if (!m) {
+			return;
+		}
+	}
+
+	hot_import(&this->hot, m->hot, state);
+	m->outstanding = 0;
+	if (state->srtt > 0) {
+		m->srtt = state->srtt;
+		m->rttvar = state->rttvar;
+		update_timeout(this, m);
+	}
+}
+
+void rtt_memory_usage(rttfd_t *this, fd_memory_t *usage) {
+	memory_add_table(usage, this->monitoreds);
+	usage->records += hashtable_count(this->monitoreds) * sizeof(monitored_t)
+			+ hot_pool_memory(&this->hot);
+	memory_total(usage);
+}
+
+static void reconfigure_monitored(char *id, void *value, void *arg) {
+	update_timeout(arg, ((fd_hot_t*) value)->cold);
+}
+
+void rtt_reconfigure(rttfd_t *this, struct hashtable *params_table) {
+	this->k = parse_long(this->k, hashtable_search(params_table, "k"));
+	fd_hashtable_foreach(this->monitoreds, reconfigure_monitored, this);
+}
+
+static void destroy_value(char *id, void *value, void *arg) {
+	destroy_monitored(((fd_hot_t*) value)->cold);
+}
+
+void rtt_destroy(rttfd_t *this) {
+	fd_hashtable_foreach(this->monitoreds, destroy_value, NULL);
+	hashtable_destroy(this->monitoreds, 0);
+	hot_pool_destroy(&this->hot);
+	free(this);
+}
+
+rttfd_t* rttfd_init_params(long k) {
+	rttfd_t *p_fd;
+	p_fd = calloc(1, sizeof(*p_fd));
+
+	p_fd->fdetector.message_received = (void*)rtt_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)rtt_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)rtt_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)rtt_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)rtt_set_to;
+	p_fd->fdetector.get_timeout = (void*)rtt_get_to;
+	p_fd->fdetector.is_failed = (void*)rtt_failed;
+	p_fd->fdetector.get_idle_time = (void*)rtt_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)rtt_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)rtt_should_ping;
+	p_fd->fdetector.release_monitored = (void*)rtt_release;
+	p_fd->fdetector.register_many = (void*)rtt_reg_many;
+	p_fd->fdetector.release_many = (void*)rtt_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)rtt_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)rtt_export_states;
+	p_fd->fdetector.import_state = (void*)rtt_import_state;
+	p_fd->fdetector.memory_usage = (void*)rtt_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)rtt_reconfigure;
+	p_fd->fdetector.destroy = (void*)rtt_destroy;
+	p_fd->fdetector.get_rtt = (void*)rtt_get_rtt;
+
+	p_fd->monitoreds = create_fd_hashtable();
+	p_fd->k = k;
+	return p_fd;
+}
+
+rttfd_t* rttfd_init(struct hashtable *params_table) {
+	return rttfd_init_params(parse_long(DEF_K, hashtable_search(params_table, "k")));
+}
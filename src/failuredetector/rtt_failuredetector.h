@@ -0,0 +1,46 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RTT_FAILUREDETECTOR_H_
+#define RTT_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+#include "fd_hot.h"
+
+/* Pairs each PING sent with its reply and keeps a TCP style smoothed
+ * round trip time and deviation, in integer arithmetic. The timeout is
+ * eta + SRTT + k * RTTVAR, and the registration timeout until the first
+ * reply. Replies to a ping sent while another was outstanding are not
+ * sampled, as their round trip is ambiguous. */
+typedef struct {
+	fdetector_t fdetector;
+	struct hashtable *monitoreds; //ids to hot records
+	fd_hot_pool_t hot;
+	long k; //weight of RTTVAR in the timeout
+} rttfd_t;
+
+rttfd_t* rttfd_init(struct hashtable *params_table);
+
+rttfd_t* rttfd_init_params(long k);
+
+/* Smoothed round trip time to id, or -1 if fd does not measure round
+ * trips or has had no reply from id yet. */
+long fd_get_rtt(fdetector_t *fd, char *id);
+
+#endif /* RTT_FAILUREDETECTOR_H_ */
@@ -0,0 +1,1218 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include "sharded_failuredetector.h"
+#include "failuredetector.h"
+#include "failuredetector_factory.h"
+#include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_opt_parser.h"
+#include "fd_memory.h"
+#include "../hashtable/hashtable.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEF_INNER "chen"
+
+enum {
+	EV_RECEIVED,
+	EV_SENT,
+	EV_SET_TIMEOUT,
+	EV_SET_PING_INTERVAL,
+	EV_REGISTER,
+	EV_RELEASE,
+	EV_REGISTER_MANY,
+	EV_RELEASE_MANY,
+	EV_RECYCLE,
+	EV_CALL,
+	EV_STOP
+};
+
+#define NO_SLOT -1
+/* free_next of a slot released but not recycled yet */
+#define UNLINKED -2
+/* slots in the first chunk, as a power of two; each next chunk doubles */
+#define SLOT_CHUNK_BITS 6
+#define MAX_CHUNKS 25
+#define MIN_BUCKETS 64
+#define MIN_ID_CAPACITY 16
+/* links followed before a walk is assumed to have crossed a rebuild */
+#define MAX_WALK 4096
+
+typedef struct fd_event {
+	struct fd_event *next;
+	int op;
+	int type;
+	long now;
+	long value;
+	char *group;
+	void *arg;
+	int count; //ids in arg for the _MANY events, slots for EV_RECYCLE
+	int recycled; //slot the worker recycles after the event, or NO_SLOT
+	char id[];
+} fd_event_t;
+
+/* What queries read, in slots that are never freed before the detector,
+ * so that readers can follow any slot they reach and validate what they
+ * read against its seqlock. A slot in use is written only by the shard's
+ * worker; a free one only by the producer taking it, before linking it.
+ * Aligned so that publishing one never invalidates another's line. */
+typedef struct {
+	unsigned int seq;
+	unsigned int hash;
+	int next[2]; //next slot in the bucket's chain, by index parity
+	int free_next;
+	int in_use;
+	char *id; //its last byte is always 0
+	long last_heard;
+	long timeout;
+	long next_ping;
+	int id_capacity;
+} __attribute__((aligned(FD_CACHE_LINE))) published_t;
+
+typedef struct {
+	long last_heard;
+	long timeout;
+	long next_ping;
+} published_times_t;
+
+typedef struct retired_id {
+	struct retired_id *next;
+	char *id;
+} retired_id_t;
+
+/* Chain heads by hash. A rebuilt index chains the slots through the other
+ * next field, so that readers of the previous one are not disturbed, and
+ * the previous one is kept until the shard is released. */
+typedef struct published_index {
+	struct published_index *retired;
+	int parity;
+	unsigned int mask;
+	int heads[];
+} published_index_t;
+
+typedef struct {
+	void (*fn)(struct fd_shard *shard, void *arg);
+	void *arg;
+	int done;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} sync_call_t;
+
+struct fd_shard {
+	/* written by producers */
+	fd_event_t *tail __attribute__((aligned(FD_CACHE_LINE)));
+	int waiting;
+
+	/* owned by the worker */
+	fd_event_t *head __attribute__((aligned(FD_CACHE_LINE)));
+	fd_event_t *stub;
+	fdetector_t *inner;
+	pthread_t worker;
+	int cpu;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* read lock free; changed by registrations and releases under lock */
+	pthread_mutex_t lock __attribute__((aligned(FD_CACHE_LINE)));
+	published_index_t *index;
+	published_t *chunks[MAX_CHUNKS];
+	int slots; //allocated, in use or free
+	int count; //in use
+	int free_slot; //first free, chained through free_next
+	retired_id_t *retired_ids; //outgrown id buffers
+} __attribute__((aligned(FD_CACHE_LINE)));
+
+/* Intrusive multi-producer single-consumer queue (Vyukov). Producers only
+ * swap the tail, the worker is the only one touching head. */
+static void queue_push(struct fd_shard *s, fd_event_t *e) {
+	fd_event_t *prev;
+
+	e->next = NULL;
+	prev = __atomic_exchange_n(&s->tail, e, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->next, e, __ATOMIC_RELEASE);
+}
+
+static fd_event_t* queue_pop(struct fd_shard *s) {
+	fd_event_t *head = s->head;
+	fd_event_t *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+	if (head == s->stub) {
+		if (!next) {
+			return NULL;
+		}
+		s->head = next;
+		head = next;
+		next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		s->head = next;
+		return head;
+	}
+	if (head != __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE)) {
+		/* a producer is half way through a push */
+		return NULL;
+	}
+	queue_push(s, s->stub);
+	next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		s->head = next;
+		return head;
+	}
+	return NULL;
+}
+
+static int queue_idle(struct fd_shard *s) {
+	return s->head == s->stub
+			&& __atomic_load_n(&s->tail, __ATOMIC_SEQ_CST) == s->stub;
+}
+
+static fd_event_t* new_event(int op, char *id, char *group) {
+	size_t id_size = strlen(id) + 1;
+	size_t group_size = group ? strlen(group) + 1 : 0;
+	fd_event_t *e = malloc(sizeof(*e) + id_size + group_size);
+
+	if (!e) {
+		return NULL;
+	}
+	e->op = op;
+	e->recycled = NO_SLOT;
+	memcpy(e->id, id, id_size);
+	if (group) {
+		e->group = e->id + id_size;
+		memcpy(e->group, group, group_size);
+	} else {
+		e->group = NULL;
+	}
+	return e;
+}
+
+static struct fd_shard* route(shardedfd_t *this, char *id) {
+	unsigned int h = fd_hashtable_hash(id) * 2654435761u;
+	return &this->shards[(h >> 16) % this->shards_count];
+}
+
+static void enqueue(struct fd_shard *s, fd_event_t *e) {
+	queue_push(s, e);
+	if (__atomic_load_n(&s->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&s->mutex);
+		pthread_cond_signal(&s->cond);
+		pthread_mutex_unlock(&s->mutex);
+	}
+}
+
+static published_t* slot_at(struct fd_shard *s, int n) {
+	int chunk = 31 - __builtin_clz((n >> SLOT_CHUNK_BITS) + 1);
+	published_t *base = __atomic_load_n(&s->chunks[chunk], __ATOMIC_ACQUIRE);
+	return base + n - (((1 << chunk) - 1) << SLOT_CHUNK_BITS);
+}
+
+/* Compares the id one byte at a time, as it may be rewritten meanwhile;
+ * the buffer's last byte is always 0, so the walk stays inside it. */
+static int id_equals(char *stored, char *id) {
+	char c;
+
+	if (!stored) {
+		return 0;
+	}
+	do {
+		c = __atomic_load_n(stored++, __ATOMIC_RELAXED);
+		if (c != *id) {
+			return 0;
+		}
+	} while (*id++);
+	return 1;
+}
+
+/* Lock free lookup of the slot publishing id, copying its times to out if
+ * given. Every slot read is validated against its seqlock; a slot changing
+ * under the walk, or an index rebuilt before a miss, restarts it. */
+static int find_published(struct fd_shard *s, char *id, unsigned int hash,
+		published_times_t *out) {
+	published_index_t *index;
+	int n, next, walked, match;
+	unsigned int seq;
+
+retry:
+	index = __atomic_load_n(&s->index, __ATOMIC_ACQUIRE);
+	n = __atomic_load_n(&index->heads[hash & index->mask], __ATOMIC_ACQUIRE);
+	for (walked = 0; n != NO_SLOT; walked++) {
+		published_t *p = slot_at(s, n);
+
+		if (walked == MAX_WALK) {
+			goto retry;
+		}
+		seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			goto retry;
+		}
+		match = __atomic_load_n(&p->in_use, __ATOMIC_RELAXED)
+				&& __atomic_load_n(&p->hash, __ATOMIC_RELAXED) == hash
+				&& id_equals(__atomic_load_n(&p->id, __ATOMIC_RELAXED), id);
+		if (match && out) {
+			out->last_heard = __atomic_load_n(&p->last_heard, __ATOMIC_RELAXED);
+			out->timeout = __atomic_load_n(&p->timeout, __ATOMIC_RELAXED);
+			out->next_ping = __atomic_load_n(&p->next_ping, __ATOMIC_RELAXED);
+		}
+		next = __atomic_load_n(&p->next[index->parity], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&p->seq, __ATOMIC_RELAXED) != seq) {
+			goto retry;
+		}
+		if (match) {
+			return n;
+		}
+		n = next;
+	}
+	if (index != __atomic_load_n(&s->index, __ATOMIC_ACQUIRE)) {
+		goto retry;
+	}
+	return NO_SLOT;
+}
+
+static void begin_write(published_t *p) {
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(published_t *p) {
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void write_times(published_t *p, long last_heard, long timeout,
+		long next_ping) {
+	__atomic_store_n(&p->last_heard, last_heard, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->timeout, timeout, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->next_ping, next_ping, __ATOMIC_RELAXED);
+}
+
+/* Worker only. */
+static void publish(struct fd_shard *s, published_t *p, char *id) {
+	fdetector_t *inner = s->inner;
+	long ref = p->last_heard;
+	long last_heard = ref - inner->get_idle_time(inner, id, ref);
+	long next_ping = ref + inner->get_time_to_next_ping(inner, id, ref);
+	long timeout = inner->get_timeout(inner, id);
+
+	begin_write(p);
+	write_times(p, last_heard, timeout, next_ping);
+	end_write(p);
+}
+
+static void publish_id(struct fd_shard *s, char *id) {
+	int n = find_published(s, id, fd_hashtable_hash(id), NULL);
+
+	if (n != NO_SLOT) {
+		publish(s, slot_at(s, n), id);
+	}
+}
+
+/* Returns released slots to the free list, once the worker is done with
+ * every update queued before their release. */
+static void recycle(struct fd_shard *s, int *slots, int count) {
+	int i;
+
+	pthread_mutex_lock(&s->lock);
+	for (i = 0; i < count; i++) {
+		published_t *p = slot_at(s, slots[i]);
+
+		begin_write(p);
+		__atomic_store_n(&p->in_use, 0, __ATOMIC_RELAXED);
+		end_write(p);
+		p->free_next = s->free_slot;
+		s->free_slot = slots[i];
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void apply_register_many(struct fd_shard *s, fd_event_t *e) {
+	char **ids = e->arg;
+	int i;
+
+	s->inner->register_many(s->inner, ids, e->count, e->now, e->value);
+	for (i = 0; i < e->count; i++) {
+		publish_id(s, ids[i]);
+	}
+	free(ids);
+}
+
+static void apply(struct fd_shard *s, fd_event_t *e) {
+	fdetector_t *inner = s->inner;
+	int n;
+
+	switch (e->op) {
+	case EV_RELEASE:
+		inner->release_monitored(inner, e->id);
+		return;
+	case EV_RELEASE_MANY:
+		inner->release_many(inner, e->arg, e->count);
+		free(e->arg);
+		return;
+	case EV_REGISTER_MANY:
+		apply_register_many(s, e);
+		return;
+	case EV_RECYCLE:
+		recycle(s, e->arg, e->count);
+		free(e->arg);
+		return;
+	}
+
+	/* registrations are always applied, so that a release queued right
+	 * behind them finds the id in the inner detector */
+	if (e->op == EV_REGISTER) {
+		if (e->group) {
+			inner->register_in_cohort(inner, e->id, e->group, e->now, e->value);
+		} else {
+			inner->register_monitored(inner, e->id, e->now, e->value);
+		}
+	}
+
+	/* skip updates for ids released in the meantime */
+	n = find_published(s, e->id, fd_hashtable_hash(e->id), NULL);
+	if (n == NO_SLOT) {
+		return;
+	}
+	switch (e->op) {
+	case EV_RECEIVED:
+		inner->message_received(inner, e->id, e->now, e->type);
+		break;
+	case EV_SENT:
+		inner->message_sent(inner, e->id, e->now, e->type);
+		break;
+	case EV_SET_TIMEOUT:
+		inner->set_timeout(inner, e->id, e->value);
+		break;
+	case EV_SET_PING_INTERVAL:
+		inner->set_ping_interval(inner, e->id, e->value);
+		break;
+	}
+	publish(s, slot_at(s, n), e->id);
+}
+
+static void finish_call(struct fd_shard *s, fd_event_t *e) {
+	sync_call_t *call = e->arg;
+
+	call->fn(s, call->arg);
+	pthread_mutex_lock(&call->mutex);
+	call->done = 1;
+	pthread_cond_signal(&call->cond);
+	pthread_mutex_unlock(&call->mutex);
+}
+
+/* Call and stop events belong to the thread waiting on them. */
+static void* shard_worker(void *arg) {
+	struct fd_shard *s = arg;
+	fd_event_t *e;
+
+#ifdef __linux__
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(s->cpu, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+
+	for (;;) {
+		e = queue_pop(s);
+		if (!e) {
+			if (!queue_idle(s)) {
+				sched_yield();
+				continue;
+			}
+			pthread_mutex_lock(&s->mutex);
+			__atomic_store_n(&s->waiting, 1, __ATOMIC_SEQ_CST);
+			while (queue_idle(s)) {
+				pthread_cond_wait(&s->cond, &s->mutex);
+			}
+			__atomic_store_n(&s->waiting, 0, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&s->mutex);
+			continue;
+		}
+
+		if (e->op == EV_STOP) {
+			break;
+		} else if (e->op == EV_CALL) {
+			finish_call(s, e);
+		} else {
+			apply(s, e);
+			if (e->recycled != NO_SLOT) {
+				recycle(s, &e->recycled, 1);
+			}
+			free(e);
+		}
+	}
+	return NULL;
+}
+
+/* Runs fn on the shard's worker, after every update queued so far, and
+ * waits for it to complete. */
+static void run_on_shard(struct fd_shard *s,
+		void (*fn)(struct fd_shard *shard, void *arg), void *arg) {
+	sync_call_t call;
+	fd_event_t e;
+
+	memset(&e, 0, sizeof(e));
+	e.op = EV_CALL;
+	e.arg = &call;
+	call.fn = fn;
+	call.arg = arg;
+	call.done = 0;
+	pthread_mutex_init(&call.mutex, NULL);
+	pthread_cond_init(&call.cond, NULL);
+
+	enqueue(s, &e);
+
+	pthread_mutex_lock(&call.mutex);
+	while (!call.done) {
+		pthread_cond_wait(&call.cond, &call.mutex);
+	}
+	pthread_mutex_unlock(&call.mutex);
+	pthread_mutex_destroy(&call.mutex);
+	pthread_cond_destroy(&call.cond);
+}
+
+static void read_published(shardedfd_t *this, char *id, published_times_t *out) {
+	memset(out, 0, sizeof(*out));
+	find_published(route(this, id), id, fd_hashtable_hash(id), out);
+}
+
+/* The writers below run under the shard's lock. */
+
+static int chunk_of(int n) {
+	return 31 - __builtin_clz((n >> SLOT_CHUNK_BITS) + 1);
+}
+
+static int take_slot(struct fd_shard *s) {
+	int chunk = chunk_of(s->slots);
+	size_t size;
+	void *base;
+	int n;
+
+	if (s->free_slot != NO_SLOT) {
+		n = s->free_slot;
+		s->free_slot = slot_at(s, n)->free_next;
+		return n;
+	}
+	if (!s->chunks[chunk]) {
+		size = ((size_t)1 << (chunk + SLOT_CHUNK_BITS)) * sizeof(published_t);
+		if (chunk == MAX_CHUNKS - 1 || posix_memalign(&base, FD_CACHE_LINE, size)) {
+			return NO_SLOT;
+		}
+		memset(base, 0, size);
+		__atomic_store_n(&s->chunks[chunk], base, __ATOMIC_RELEASE);
+	}
+	return s->slots++;
+}
+
+static void put_slot(struct fd_shard *s, int n) {
+	published_t *p = slot_at(s, n);
+	p->free_next = s->free_slot;
+	s->free_slot = n;
+}
+
+/* Rewrites the slot's id in place, or in a larger buffer, the outgrown
+ * one being kept for readers that may still be comparing against it. */
+static int set_id(struct fd_shard *s, published_t *p, char *id) {
+	int length = strlen(id);
+	int capacity = p->id_capacity;
+	char *buffer;
+	int i;
+
+	if (length + 1 > capacity) {
+		capacity = capacity * 2 > MIN_ID_CAPACITY ? capacity * 2 : MIN_ID_CAPACITY;
+		if (capacity < length + 1) {
+			capacity = length + 1;
+		}
+		buffer = calloc(1, capacity);
+		if (!buffer) {
+			return 0;
+		}
+		memcpy(buffer, id, length);
+		if (p->id) {
+			retired_id_t *retired = malloc(sizeof(*retired));
+			if (!retired) {
+				free(buffer);
+				return 0;
+			}
+			retired->id = p->id;
+			retired->next = s->retired_ids;
+			s->retired_ids = retired;
+		}
+		__atomic_store_n(&p->id, buffer, __ATOMIC_RELAXED);
+		p->id_capacity = capacity;
+		return 1;
+	}
+	for (i = 0; i <= length; i++) {
+		__atomic_store_n(&p->id[i], id[i], __ATOMIC_RELAXED);
+	}
+	return 1;
+}
+
+static void link_slot(struct fd_shard *s, int n) {
+	published_index_t *index = s->index;
+	published_t *p = slot_at(s, n);
+	int *head = &index->heads[p->hash & index->mask];
+
+	__atomic_store_n(&p->next[index->parity], *head, __ATOMIC_RELAXED);
+	__atomic_store_n(head, n, __ATOMIC_RELEASE);
+}
+
+/* Readers at the unlinked slot still find their way along the chain
+ * through its next field, left as it is until the slot is reused. */
+static void unlink_slot(struct fd_shard *s, int n) {
+	published_index_t *index = s->index;
+	published_t *p = slot_at(s, n);
+	int *link = &index->heads[p->hash & index->mask];
+
+	while (*link != n) {
+		link = &slot_at(s, *link)->next[index->parity];
+	}
+	__atomic_store_n(link, p->next[index->parity], __ATOMIC_RELEASE);
+}
+
+/* Doubles the buckets, chaining every slot in use through the next field
+ * the current index does not use. */
+static int grow_index(struct fd_shard *s) {
+	published_index_t *old = s->index;
+	unsigned int buckets = (old->mask + 1) * 2;
+	published_index_t *index = malloc(sizeof(*index) + buckets * sizeof(int));
+	int n;
+
+	if (!index) {
+		return 0;
+	}
+	index->retired = old;
+	index->parity = !old->parity;
+	index->mask = buckets - 1;
+	memset(index->heads, 0xff, buckets * sizeof(int));
+	for (n = 0; n < s->slots; n++) {
+		published_t *p = slot_at(s, n);
+		int *head = &index->heads[p->hash & index->mask];
+
+		if (p->in_use && p->free_next != UNLINKED) {
+			__atomic_store_n(&p->next[index->parity], *head, __ATOMIC_RELAXED);
+			*head = n;
+		}
+	}
+	__atomic_store_n(&s->index, index, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* Publishes a monitored in a fresh slot, setting replaced to the slot it
+ * had if it was registered already, NO_SLOT otherwise. Returns 0 if no
+ * slot could be allocated. */
+static int put_published(struct fd_shard *s, char *id, long last_heard,
+		long timeout, long next_ping, int *replaced) {
+	unsigned int hash = fd_hashtable_hash(id);
+	published_t *p;
+	int n;
+
+	*replaced = find_published(s, id, hash, NULL);
+	if ((unsigned int)s->count >= s->index->mask + 1) {
+		grow_index(s);
+	}
+	n = take_slot(s);
+	if (n == NO_SLOT) {
+		return 0;
+	}
+	p = slot_at(s, n);
+	begin_write(p);
+	if (!set_id(s, p, id)) {
+		end_write(p);
+		put_slot(s, n);
+		return 0;
+	}
+	__atomic_store_n(&p->hash, hash, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->in_use, 1, __ATOMIC_RELAXED);
+	p->free_next = NO_SLOT;
+	write_times(p, last_heard, timeout, next_ping);
+	end_write(p);
+
+	if (*replaced != NO_SLOT) {
+		unlink_slot(s, *replaced);
+		slot_at(s, *replaced)->free_next = UNLINKED;
+		s->count--;
+	}
+	link_slot(s, n);
+	s->count++;
+	return 1;
+}
+
+/* Unlinks the monitored's slot, returning it or NO_SLOT. The slot stays
+ * in use for the worker until it recycles it. */
+static int remove_published(struct fd_shard *s, char *id) {
+	int n = find_published(s, id, fd_hashtable_hash(id), NULL);
+
+	if (n != NO_SLOT) {
+		unlink_slot(s, n);
+		slot_at(s, n)->free_next = UNLINKED;
+		s->count--;
+	}
+	return n;
+}
+
+static void register_event(shardedfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	struct fd_shard *s = route(this, id);
+	fd_event_t *e = new_event(EV_REGISTER, id, group);
+	int ok;
+
+	if (!e) {
+		return;
+	}
+	/* published right away so queries work before the worker catches up */
+	pthread_mutex_lock(&s->lock);
+	ok = put_published(s, id, now, timeout, now + timeout / 2, &e->recycled);
+	pthread_mutex_unlock(&s->lock);
+	if (!ok) {
+		free(e);
+		return;
+	}
+	e->now = now;
+	e->value = timeout;
+	enqueue(s, e);
+}
+
+void sharded_reg_monitored(shardedfd_t *this, char *id, long now, long timeout) {
+	register_event(this, id, NULL, now, timeout);
+}
+
+void sharded_reg_in_cohort(shardedfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	register_event(this, id, group, now, timeout);
+}
+
+void sharded_release(shardedfd_t *this, char *id) {
+	struct fd_shard *s = route(this, id);
+	fd_event_t *e = new_event(EV_RELEASE, id, NULL);
+
+	if (!e) {
+		return;
+	}
+	pthread_mutex_lock(&s->lock);
+	e->recycled = remove_published(s, id);
+	pthread_mutex_unlock(&s->lock);
+	enqueue(s, e);
+}
+
+/* Copies the ids routed to one shard into a single block, pointers first. */
+static char** copy_ids(char **ids, int *selected, int count) {
+	size_t size = count * sizeof(char*);
+	char **copy;
+	char *str;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		size += strlen(ids[selected[i]]) + 1;
+	}
+	copy = malloc(size);
+	if (!copy) {
+		return NULL;
+	}
+	str = (char*)(copy + count);
+	for (i = 0; i < count; i++) {
+		copy[i] = str;
+		str = stpcpy(str, ids[selected[i]]) + 1;
+	}
+	return copy;
+}
+
+/* Groups ids by shard: on return selected holds the indexes of the ids
+ * routed to shard i at selected[first[i]] .. selected[first[i + 1] - 1].
+ * Returns 0 if out of memory. */
+static int group_by_shard(shardedfd_t *this, char **ids, int count,
+		int *first, int *selected) {
+	int *next = calloc(this->shards_count, sizeof(int));
+	int *shard_of = malloc(count * sizeof(int));
+	int i;
+
+	if (!next || !shard_of) {
+		free(next);
+		free(shard_of);
+		return 0;
+	}
+	memset(first, 0, (this->shards_count + 1) * sizeof(int));
+	for (i = 0; i < count; i++) {
+		shard_of[i] = route(this, ids[i]) - this->shards;
+		first[shard_of[i] + 1]++;
+	}
+	for (i = 0; i < this->shards_count; i++) {
+		first[i + 1] += first[i];
+		next[i] = first[i];
+	}
+	for (i = 0; i < count; i++) {
+		selected[next[shard_of[i]]++] = i;
+	}
+	free(next);
+	free(shard_of);
+	return 1;
+}
+
+/* Queues the slots for the worker to recycle once done with the events
+ * queued before. */
+static void enqueue_recycle(struct fd_shard *s, int *slots, int count) {
+	fd_event_t *e;
+
+	if (count == 0 || !(e = new_event(EV_RECYCLE, "", NULL))) {
+		/* the slots stay unlinked, never reused */
+		free(slots);
+		return;
+	}
+	e->arg = slots;
+	e->count = count;
+	enqueue(s, e);
+}
+
+/* Registers the shard's share of the ids, as many as slots could be
+ * allocated for. */
+static void register_shard(struct fd_shard *s, char **ids, int *selected,
+		int n, long now, long timeout) {
+	fd_event_t *e = new_event(EV_REGISTER_MANY, "", NULL);
+	int *replaced = malloc(n * sizeof(int));
+	int recycled = 0;
+	int j;
+
+	if (!e || !replaced || !(e->arg = copy_ids(ids, selected, n))) {
+		free(e);
+		free(replaced);
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	for (j = 0; j < n; j++) {
+		if (!put_published(s, ids[selected[j]], now, timeout,
+				now + timeout / 2, &replaced[recycled])) {
+			break;
+		}
+		if (replaced[recycled] != NO_SLOT) {
+			recycled++;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	e->count = j;
+	e->now = now;
+	e->value = timeout;
+	enqueue(s, e);
+	enqueue_recycle(s, replaced, recycled);
+}
+
+void sharded_reg_many(shardedfd_t *this, char **ids, int count, long now,
+		long timeout) {
+	int *first = malloc((this->shards_count + 1) * sizeof(int));
+	int *selected = malloc(count * sizeof(int));
+	int i;
+
+	if (first && selected && group_by_shard(this, ids, count, first, selected)) {
+		for (i = 0; i < this->shards_count; i++) {
+			if (first[i + 1] > first[i]) {
+				register_shard(&this->shards[i], ids, selected + first[i],
+						first[i + 1] - first[i], now, timeout);
+			}
+		}
+	}
+	free(first);
+	free(selected);
+}
+
+static void release_shard(struct fd_shard *s, char **ids, int *selected,
+		int n) {
+	fd_event_t *e = new_event(EV_RELEASE_MANY, "", NULL);
+	int *released = malloc(n * sizeof(int));
+	int count = 0;
+	int j;
+
+	if (!e || !released || !(e->arg = copy_ids(ids, selected, n))) {
+		free(e);
+		free(released);
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	for (j = 0; j < n; j++) {
+		released[count] = remove_published(s, ids[selected[j]]);
+		if (released[count] != NO_SLOT) {
+			count++;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	e->count = n;
+	enqueue(s, e);
+	enqueue_recycle(s, released, count);
+}
+
+void sharded_release_many(shardedfd_t *this, char **ids, int count) {
+	int *first = malloc((this->shards_count + 1) * sizeof(int));
+	int *selected = malloc(count * sizeof(int));
+	int i;
+
+	if (first && selected && group_by_shard(this, ids, count, first, selected)) {
+		for (i = 0; i < this->shards_count; i++) {
+			if (first[i + 1] > first[i]) {
+				release_shard(&this->shards[i], ids, selected + first[i],
+						first[i + 1] - first[i]);
+			}
+		}
+	}
+	free(first);
+	free(selected);
+}
+
+/* An update that cannot be queued is dropped, as a lost message would be. */
+static void update_event(shardedfd_t *this, int op, char *id, long now,
+		int type, long value) {
+	fd_event_t *e = new_event(op, id, NULL);
+
+	if (!e) {
+		return;
+	}
+	e->now = now;
+	e->type = type;
+	e->value = value;
+	enqueue(route(this, id), e);
+}
+
+void sharded_msg_rcv(shardedfd_t *this, char *id, long now, int type) {
+	update_event(this, EV_RECEIVED, id, now, type, 0);
+}
+
+void sharded_msg_sent(shardedfd_t *this, char *id, long now, int type) {
+	update_event(this, EV_SENT, id, now, type, 0);
+}
+
+void sharded_set_to(shardedfd_t *this, char *id, long timeout) {
+	update_event(this, EV_SET_TIMEOUT, id, 0, 0, timeout);
+}
+
+void sharded_set_ping_interval(shardedfd_t *this, char *id, long interval) {
+	update_event(this, EV_SET_PING_INTERVAL, id, 0, 0, interval);
+}
+
+long sharded_get_to(shardedfd_t *this, char *id) {
+	published_times_t p;
+	read_published(this, id, &p);
+	return p.timeout;
+}
+
+int sharded_failed(shardedfd_t *this, char *id, long now) {
+	published_times_t p;
+	read_published(this, id, &p);
+	return now > p.last_heard + p.timeout;
+}
+
+long sharded_get_idle(shardedfd_t *this, char *id, long now) {
+	published_times_t p;
+	read_published(this, id, &p);
+	return now - p.last_heard;
+}
+
+long sharded_time_next_ping(shardedfd_t *this, char *id, long now) {
+	published_times_t p;
+	read_published(this, id, &p);
+	return p.next_ping - now;
+}
+
+int sharded_should_ping(shardedfd_t *this, char *id, long now) {
+	return sharded_time_next_ping(this, id, now) <= 0;
+}
+
+static void export_call(struct fd_shard *s, void *visitor) {
+	s->inner->export_states(s->inner, visitor);
+}
+
+void sharded_export_states(shardedfd_t *this, fd_state_visitor_t *visitor) {
+	int i;
+	for (i = 0; i < this->shards_count; i++) {
+		run_on_shard(&this->shards[i], export_call, visitor);
+	}
+}
+
+typedef struct {
+	fd_state_t *state;
+	int replaced;
+} import_t;
+
+static void import_call(struct fd_shard *s, void *arg) {
+	import_t *import = arg;
+
+	s->inner->import_state(s->inner, import->state);
+	publish_id(s, import->state->id);
+	if (import->replaced != NO_SLOT) {
+		recycle(s, &import->replaced, 1);
+	}
+}
+
+void sharded_import_state(shardedfd_t *this, fd_state_t *state) {
+	struct fd_shard *s = route(this, state->id);
+	import_t import = { state, NO_SLOT };
+	int ok;
+
+	pthread_mutex_lock(&s->lock);
+	ok = put_published(s, state->id, state->last_heard, state->timeout,
+			state->last_sent + state->eta, &import.replaced);
+	pthread_mutex_unlock(&s->lock);
+	if (ok) {
+		run_on_shard(s, import_call, &import);
+	}
+}
+
+static long chunks_size(struct fd_shard *s) {
+	long size = 0;
+	int i;
+
+	for (i = 0; i < MAX_CHUNKS && s->chunks[i]; i++) {
+		size += ((long)1 << (i + SLOT_CHUNK_BITS)) * sizeof(published_t);
+	}
+	return size;
+}
+
+static void memory_call(struct fd_shard *s, void *arg) {
+	fd_memory_t *usage = arg;
+	fd_memory_t inner;
+	published_index_t *index;
+	int n;
+
+	fd_memory_usage(s->inner, &inner);
+	usage->table += inner.table;
+	usage->records += inner.records;
+	usage->windows += inner.windows;
+	usage->keys += inner.keys;
+
+	pthread_mutex_lock(&s->lock);
+	for (index = s->index; index; index = index->retired) {
+		usage->table += sizeof(*index) + (index->mask + 1) * sizeof(int);
+	}
+	usage->records += chunks_size(s);
+	for (n = 0; n < s->slots; n++) {
+		usage->keys += slot_at(s, n)->id_capacity;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* Sums the shards' usage, after the updates queued so far. */
+void sharded_memory_usage(shardedfd_t *this, fd_memory_t *usage) {
+	int i;
+
+	usage->records += this->shards_count * sizeof(struct fd_shard);
+	for (i = 0; i < this->shards_count; i++) {
+		run_on_shard(&this->shards[i], memory_call, usage);
+	}
+	memory_total(usage);
+}
+
+static void copy_param(char *key, void *value, void *copy) {
+	fd_hashtable_insert(copy, key, value);
+}
+
+/* The parameters each shard's detector is created with: the memory budget
+ * bounds the whole detector, so every shard gets an even share of it. */
+static struct hashtable* shard_params(struct hashtable *params_table,
+		int shards_count, char *budget, size_t size) {
+	struct hashtable *params = create_fd_hashtable();
+	char *value;
+
+	fd_hashtable_foreach(params_table, copy_param, params);
+	value = hashtable_remove(params, "memorybudget");
+	if (value) {
+		snprintf(budget, size, "%ld", parse_long(0, value) / shards_count);
+		fd_hashtable_insert(params, "memorybudget", budget);
+	}
+	return params;
+}
+
+/* Holds the lock so that no producer is setting up a slot's id. */
+static void reconfigure_call(struct fd_shard *s, void *params) {
+	int n;
+
+	fd_reconfigure(s->inner, params);
+	pthread_mutex_lock(&s->lock);
+	for (n = 0; n < s->slots; n++) {
+		published_t *p = slot_at(s, n);
+
+		if (p->in_use && p->free_next != UNLINKED) {
+			publish(s, p, p->id);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* Every shard applies the parameters between two of its updates. */
+void sharded_reconfigure(shardedfd_t *this, struct hashtable *params_table) {
+	char budget[24];
+	struct hashtable *params = shard_params(params_table, this->shards_count,
+			budget, sizeof(budget));
+	int i;
+
+	for (i = 0; i < this->shards_count; i++) {
+		run_on_shard(&this->shards[i], reconfigure_call, params);
+	}
+	hashtable_destroy(params, 0);
+}
+
+/* Frees what readers may still have been looking at, once none is left. */
+static void release_published(struct fd_shard *s) {
+	published_index_t *index = s->index;
+	retired_id_t *retired = s->retired_ids;
+	int n;
+
+	for (n = 0; n < s->slots; n++) {
+		free(slot_at(s, n)->id);
+	}
+	for (n = 0; n < MAX_CHUNKS; n++) {
+		free(s->chunks[n]);
+	}
+	while (index) {
+		published_index_t *next = index->retired;
+		free(index);
+		index = next;
+	}
+	while (retired) {
+		retired_id_t *next = retired->next;
+		free(retired->id);
+		free(retired);
+		retired = next;
+	}
+}
+
+static void release_shard_state(struct fd_shard *s) {
+	fd_destroy(s->inner);
+	release_published(s);
+	free(s->stub);
+	pthread_mutex_destroy(&s->mutex);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+}
+
+static int init_shard(struct fd_shard *s, char *inner_name,
+		struct hashtable *params_table, int cpu) {
+	s->inner = create_failure_detector(inner_name, params_table);
+	if (!s->inner) {
+		return 0;
+	}
+	s->stub = calloc(1, sizeof(*s->stub));
+	s->index = malloc(sizeof(*s->index) + MIN_BUCKETS * sizeof(int));
+	s->head = s->stub;
+	s->tail = s->stub;
+	s->cpu = cpu;
+	s->free_slot = NO_SLOT;
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	pthread_mutex_init(&s->lock, NULL);
+	if (s->index) {
+		s->index->retired = NULL;
+		s->index->parity = 0;
+		s->index->mask = MIN_BUCKETS - 1;
+		memset(s->index->heads, 0xff, MIN_BUCKETS * sizeof(int));
+	}
+	if (!s->stub || !s->index
+			|| pthread_create(&s->worker, NULL, shard_worker, s) != 0) {
+		release_shard_state(s);
+		return 0;
+	}
+	return 1;
+}
+
+shardedfd_t* shardedfd_init_params(char *inner_name, int shards_count,
+		struct hashtable *params_table) {
+	shardedfd_t *p_fd;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct hashtable *params;
+	char budget[24];
+	void *shards;
+	int i;
+
+	if (strcmp(inner_name, "sharded") == 0 || shards_count < 1) {
+		return NULL;
+	}
+	if (cpus < 1) {
+		cpus = 1;
+	}
+	if (posix_memalign(&shards, FD_CACHE_LINE,
+			shards_count * sizeof(struct fd_shard))) {
+		return NULL;
+	}
+	memset(shards, 0, shards_count * sizeof(struct fd_shard));
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)sharded_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)sharded_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)sharded_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)sharded_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)sharded_set_to;
+	p_fd->fdetector.get_timeout = (void*)sharded_get_to;
+	p_fd->fdetector.is_failed = (void*)sharded_failed;
+	p_fd->fdetector.get_idle_time = (void*)sharded_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)sharded_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)sharded_should_ping;
+	p_fd->fdetector.release_monitored = (void*)sharded_release;
+	p_fd->fdetector.register_many = (void*)sharded_reg_many;
+	p_fd->fdetector.release_many = (void*)sharded_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)sharded_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)sharded_export_states;
+	p_fd->fdetector.import_state = (void*)sharded_import_state;
+	p_fd->fdetector.memory_usage = (void*)sharded_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)sharded_reconfigure;
+	p_fd->fdetector.destroy = (void*)shardedfd_destroy;
+
+	p_fd->shards = shards;
+	params = shard_params(params_table, shards_count, budget, sizeof(budget));
+	for (i = 0; i < shards_count; i++) {
+		if (!init_shard(&p_fd->shards[i], inner_name, params, i % cpus)) {
+			hashtable_destroy(params, 0);
+			p_fd->shards_count = i;
+			shardedfd_destroy(p_fd);
+			return NULL;
+		}
+	}
+	hashtable_destroy(params, 0);
+	p_fd->shards_count = shards_count;
+	return p_fd;
+}
+
+shardedfd_t* shardedfd_init(struct hashtable *params_table) {
+	char *inner = hashtable_search(params_table, "inner");
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return shardedfd_init_params(inner ? inner : DEF_INNER,
+			parse_int(cpus > 0 ? cpus : 1, hashtable_search(params_table, "shards")),
+			params_table);
+}
+
+void shardedfd_destroy(shardedfd_t *this) {
+	fd_event_t stop;
+	int i;
+
+	memset(&stop, 0, sizeof(stop));
+	stop.op = EV_STOP;
+	for (i = 0; i < this->shards_count; i++) {
+		struct fd_shard *s = &this->shards[i];
+
+		stop.next = NULL;
+		enqueue(s, &stop);
+		pthread_join(s->worker, NULL);
+		release_shard_state(s);
+	}
+	free(this->shards);
+	free(this);
+}
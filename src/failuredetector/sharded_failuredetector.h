@@ -0,0 +1,42 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHARDED_FAILUREDETECTOR_H_
+#define SHARDED_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+struct fd_shard;
+
+/* Routes monitored ids by hash to shards, each owning an inner detector
+ * driven by its own worker thread. Updates are queued to the owning shard;
+ * queries are answered from state the shard publishes after each update,
+ * so they never wait for the worker. */
+typedef struct {
+	fdetector_t fdetector;
+	int shards_count;
+	struct fd_shard *shards;
+} shardedfd_t;
+
+shardedfd_t* shardedfd_init(struct hashtable *params_table);
+
+/* Stops the worker threads and releases every shard. */
+void shardedfd_destroy(shardedfd_t *this);
+
+#endif /* SHARDED_FAILUREDETECTOR_H_ */
@@ -0,0 +1,670 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shm_failuredetector.h"
+#include "failuredetector.h"
+#include "fd_hashtable.h"
+#include "fd_batch.h"
+#include "fd_memory.h"
+#include "fd_opt_parser.h"
+#include "../hashtable/hashtable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_NAME "/fdetector"
+#define DEF_CAPACITY 1024l
+#define DEF_ALPHA 5000l
+#define SHM_MAGIC 0x66647368u
+/* interarrivals each record keeps */
+#define SHM_WINDOW 128
+/* ping intervals the pinger may miss before another process takes over */
+#define LEASE_INTERVALS 3
+/* a millisecond apart, for a segment another process is creating */
+#define ATTACH_POLLS 1000
+/* failed attempts at reading a record before checking on its writer */
+#define READ_SPINS 1024
+
+enum { SLOT_EMPTY, SLOT_USED, SLOT_DELETED };
+
+typedef struct {
+	unsigned int seq; //odd while the record is written
+	int state;
+	int users; //processes that registered the id
+	pid_t pinger; //process holding the ping lease, 0 for none
+	long lease_end;
+	char id[SHM_ID_LEN];
+
+	long last_heard;
+	long last_sent;
+	long timeout;
+	long eta;
+	long last_ping; //arrival of the last ping, 0 before the first
+	long sum; //of the interarrivals in the window
+	int size;
+	int start; //index of the oldest interarrival
+	unsigned int interarrivals[SHM_WINDOW];
+} __attribute__((aligned(FD_CACHE_LINE))) shm_record_t;
+
+/* The records are an open addressing table with linear probing, written
+ * under the lock. Released records become tombstones, or empty slots when
+ * no probe sequence runs through them. */
+struct shm_segment {
+	unsigned int magic; //set once the creator initialised the segment
+	int unlinked; //the last process detached, attach to a new segment
+	long slots; //a power of two, at least twice the capacity
+	long capacity;
+	long count;
+	long attached;
+	long alpha;
+	pthread_mutex_t lock;
+	shm_record_t records[];
+};
+
+/* What queries read of a record. */
+typedef struct {
+	long last_heard;
+	long last_sent;
+	long timeout;
+	long eta;
+} shm_view_t;
+
+typedef struct {
+	struct shm_segment *segment;
+	fd_state_visitor_t *visitor;
+} shm_export_t;
+
+static size_t segment_size(long slots) {
+	return sizeof(struct shm_segment) + slots * sizeof(shm_record_t);
+}
+
+static long home_slot(struct shm_segment *seg, char *id) {
+	return (fd_hashtable_hash(id) * 2654435761u) & (seg->slots - 1);
+}
+
+static void begin_write(shm_record_t *r) {
+	__atomic_store_n(&r->seq, r->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(shm_record_t *r) {
+	__atomic_store_n(&r->seq, r->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Completes the records a dead process was writing. Their window sum may
+ * be stale, so it is recomputed. */
+static void repair(struct shm_segment *seg) {
+	long i;
+	int j;
+
+	for (i = 0; i < seg->slots; i++) {
+		shm_record_t *r = &seg->records[i];
+
+		if (r->seq & 1) {
+			r->sum = 0;
+			for (j = 0; j < r->size; j++) {
+				r->sum += r->interarrivals[(r->start + j) % SHM_WINDOW];
+			}
+			end_write(r);
+		}
+	}
+}
+
+static void lock(struct shm_segment *seg) {
+	if (pthread_mutex_lock(&seg->lock) == EOWNERDEAD) {
+		repair(seg);
+		pthread_mutex_consistent(&seg->lock);
+	}
+}
+
+static void unlock(struct shm_segment *seg) {
+	pthread_mutex_unlock(&seg->lock);
+}
+
+static void read_view(struct shm_segment *seg, shm_record_t *r, shm_view_t *out) {
+	unsigned int seq;
+	int spins = 0;
+
+	do {
+		/* a writer that died mid update is repaired by the next lock */
+		if (++spins > READ_SPINS) {
+			lock(seg);
+			unlock(seg);
+			spins = 0;
+		}
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		out->last_heard = __atomic_load_n(&r->last_heard, __ATOMIC_RELAXED);
+		out->last_sent = __atomic_load_n(&r->last_sent, __ATOMIC_RELAXED);
+		out->timeout = __atomic_load_n(&r->timeout, __ATOMIC_RELAXED);
+		out->eta = __atomic_load_n(&r->eta, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&r->seq, __ATOMIC_RELAXED));
+}
+
+/* Reads id's record. Returns 0 if this process has not registered id. */
+static int view(shmfd_t *this, char *id, shm_view_t *out) {
+	shm_record_t *r = hashtable_search(this->local, id);
+
+	if (!r) {
+		memset(out, 0, sizeof(*out));
+		return 0;
+	}
+	read_view(this->segment, r, out);
+	return 1;
+}
+
+/* Interarrivals that do not fit the window's 32 bits saturate. */
+static void add_interarrival(shm_record_t *r, long interarrival) {
+	unsigned int sample = interarrival > UINT_MAX ? UINT_MAX : interarrival;
+
+	if (r->size == SHM_WINDOW) {
+		r->sum -= r->interarrivals[r->start];
+		r->start = (r->start + 1) % SHM_WINDOW;
+		r->size--;
+	}
+	r->interarrivals[(r->start + r->size) % SHM_WINDOW] = sample;
+	r->sum += sample;
+	r->size++;
+}
+
+static void update_timeout(struct shm_segment *seg, shm_record_t *r) {
+	if (r->size > 0) {
+		__atomic_store_n(&r->timeout, r->sum / r->size + seg->alpha,
+				__ATOMIC_RELAXED);
+	}
+}
+
+/* The slot holding id or, with insert, the first slot it can take on its
+ * probe sequence. -1 if there is none. Called with the lock held. */
+static long find_slot(struct shm_segment *seg, char *id, int insert) {
+	long mask = seg->slots - 1;
+	long free_slot = -1;
+	long i, n;
+
+	for (i = home_slot(seg, id), n = 0; n < seg->slots; i = (i + 1) & mask, n++) {
+		shm_record_t *r = &seg->records[i];
+
+		if (r->state == SLOT_USED && !strcmp(r->id, id)) {
+			return i;
+		}
+		if (r->state != SLOT_USED && free_slot < 0) {
+			free_slot = i;
+		}
+		if (r->state == SLOT_EMPTY) {
+			break;
+		}
+	}
+	return insert ? free_slot : -1;
+}
+
+void shm_reg_monitored(shmfd_t *this, char *id, long now, long timeout) {
+	struct shm_segment *seg = this->segment;
+	shm_record_t *r;
+	long slot;
+
+	if (strlen(id) >= SHM_ID_LEN || hashtable_search(this->local, id)) {
+		return;
+	}
+	lock(seg);
+	slot = find_slot(seg, id, 1);
+	if (slot < 0 || (seg->records[slot].state != SLOT_USED
+			&& seg->count == seg->capacity)) {
+		unlock(seg);
+		return;
+	}
+	r = &seg->records[slot];
+	if (r->state != SLOT_USED) {
+		begin_write(r);
+		r->state = SLOT_USED;
+		r->users = 0;
+		__atomic_store_n(&r->pinger, 0, __ATOMIC_RELAXED);
+		strcpy(r->id, id);
+		__atomic_store_n(&r->last_heard, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->last_sent, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->timeout, timeout, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->eta, timeout / 2, __ATOMIC_RELAXED);
+		r->last_ping = 0;
+		r->sum = 0;
+		r->size = 0;
+		r->start = 0;
+		end_write(r);
+		seg->count++;
+	}
+	r->users++;
+	unlock(seg);
+	fd_hashtable_insert(this->local, id, r);
+}
+
+void shm_reg_in_cohort(shmfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	shm_reg_monitored(this, id, now, timeout);
+}
+
+void shm_reg_many(shmfd_t *this, char **ids, int count, long now, long timeout) {
+	int i;
+	for (i = 0; i < count; i++) {
+		shm_reg_monitored(this, ids[i], now, timeout);
+	}
+}
+
+static void release_record(shmfd_t *this, shm_record_t *r) {
+	struct shm_segment *seg = this->segment;
+	long mask = seg->slots - 1;
+	long slot = r - seg->records;
+	pid_t pid = this->pid;
+
+	lock(seg);
+	/* the next process finding a ping due takes the lease over */
+	__atomic_compare_exchange_n(&r->pinger, &pid, 0, 0, __ATOMIC_ACQ_REL,
+			__ATOMIC_RELAXED);
+	if (--r->users == 0) {
+		begin_write(r);
+		r->state = SLOT_DELETED;
+		end_write(r);
+		seg->count--;
+		while (seg->records[slot].state == SLOT_DELETED
+				&& seg->records[(slot + 1) & mask].state == SLOT_EMPTY) {
+			begin_write(&seg->records[slot]);
+			seg->records[slot].state = SLOT_EMPTY;
+			end_write(&seg->records[slot]);
+			slot = (slot - 1) & mask;
+		}
+	}
+	unlock(seg);
+}
+
+void shm_release(shmfd_t *this, char *id) {
+	shm_record_t *r = hashtable_remove(this->local, id);
+
+	if (r) {
+		release_record(this, r);
+	}
+}
+
+void shm_release_many(shmfd_t *this, char **ids, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		shm_release(this, ids[i]);
+	}
+}
+
+void shm_msg_rcv(shmfd_t *this, char *id, long now, int type) {
+	struct shm_segment *seg = this->segment;
+	shm_record_t *r = hashtable_search(this->local, id);
+
+	if (!r) {
+		return;
+	}
+	lock(seg);
+	begin_write(r);
+	/* arrivals reported by other processes may be slightly out of order */
+	if (type == PING && now > r->last_ping) {
+		if (r->last_ping) {
+			add_interarrival(r, now - r->last_ping);
+			update_timeout(seg, r);
+		}
+		r->last_ping = now;
+	}
+	if (now > r->last_heard) {
+		__atomic_store_n(&r->last_heard, now, __ATOMIC_RELAXED);
+	}
+	end_write(r);
+	unlock(seg);
+}
+
+void shm_msg_sent(shmfd_t *this, char *id, long now, int type) {
+	struct shm_segment *seg = this->segment;
+	shm_record_t *r = hashtable_search(this->local, id);
+
+	if (!r) {
+		return;
+	}
+	lock(seg);
+	if (now > r->last_sent) {
+		begin_write(r);
+		__atomic_store_n(&r->last_sent, now, __ATOMIC_RELAXED);
+		end_write(r);
+	}
+	unlock(seg);
+}
+
+void shm_set_to(shmfd_t *this, char *id, long timeout) {
+	shm_record_t *r = hashtable_search(this->local, id);
+
+	if (!r) {
+		return;
+	}
+	lock(this->segment);
+	begin_write(r);
+	__atomic_store_n(&r->timeout, timeout, __ATOMIC_RELAXED);
+	end_write(r);
+	unlock(this->segment);
+}
+
+void shm_set_ping_interval(shmfd_t *this, char *id, long interval) {
+	shm_record_t *r = hashtable_search(this->local, id);
+
+	if (!r) {
+		return;
+	}
+	lock(this->segment);
+	begin_write(r);
+	__atomic_store_n(&r->eta, interval, __ATOMIC_RELAXED);
+	end_write(r);
+	unlock(this->segment);
+}
+
+/* Monitoreds this process did not register are reported failed. */
+int shm_failed(shmfd_t *this, char *id, long now) {
+	shm_view_t v;
+	return !view(this, id, &v) || now > v.last_heard + v.timeout;
+}
+
+long shm_get_idle(shmfd_t *this, char *id, long now) {
+	shm_view_t v;
+	view(this, id, &v);
+	return now - v.last_heard;
+}
+
+long shm_time_next_ping(shmfd_t *this, char *id, long now) {
+	shm_view_t v;
+	view(this, id, &v);
+	return v.eta - (now - v.last_sent);
+}
+
+long shm_get_to(shmfd_t *this, char *id) {
+	shm_view_t v;
+	view(this, id, &v);
+	return v.timeout;
+}
+
+/* The lease is renewed each time its holder finds a ping due, and taken
+ * over by the next process finding one due once the holder has missed
+ * LEASE_INTERVALS pings, released the monitored or detached. */
+static int hold_lease(shmfd_t *this, shm_record_t *r, long eta, long now) {
+	pid_t pinger = __atomic_load_n(&r->pinger, __ATOMIC_ACQUIRE);
+
+	if (pinger != this->pid) {
+		if (pinger && now <= __atomic_load_n(&r->lease_end, __ATOMIC_RELAXED)) {
+			return 0;
+		}
+		if (!__atomic_compare_exchange_n(&r->pinger, &pinger, this->pid, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return 0;
+		}
+	}
+	__atomic_store_n(&r->lease_end, now + LEASE_INTERVALS * eta,
+			__ATOMIC_RELAXED);
+	return 1;
+}
+
+/* Only the process holding the monitored's ping lease is told to ping. */
+int shm_should_ping(shmfd_t *this, char *id, long now) {
+	shm_record_t *r = hashtable_search(this->local, id);
+	shm_view_t v;
+
+	if (!r) {
+		return 0;
+	}
+	read_view(this->segment, r, &v);
+	return v.eta - (now - v.last_sent) <= 0 && hold_lease(this, r, v.eta, now);
+}
+
+static void export_record(char *id, void *value, void *arg) {
+	shm_export_t *export = arg;
+	shm_record_t *r = value;
+	long interarrivals[SHM_WINDOW];
+	fd_state_t state;
+	int i;
+
+	memset(&state, 0, sizeof(state));
+	state.id = id;
+	lock(export->segment);
+	state.timeout = r->timeout;
+	state.last_heard = r->last_heard;
+	state.last_sent = r->last_sent;
+	state.eta = r->eta;
+	state.last_ping = r->last_ping;
+	state.window_size = r->size;
+	for (i = 0; i < r->size; i++) {
+		interarrivals[i] = r->interarrivals[(r->start + i) % SHM_WINDOW];
+	}
+	unlock(export->segment);
+	state.interarrivals = interarrivals;
+
+	export->visitor->visit(export->visitor, &state);
+}
+
+void shm_export_states(shmfd_t *this, fd_state_visitor_t *visitor) {
+	shm_export_t export = { this->segment, visitor };
+
+	fd_hashtable_foreach(this->local, export_record, &export);
+}
+
+/* A record other processes also registered keeps its shared state. */
+void shm_import_state(shmfd_t *this, fd_state_t *state) {
+	struct shm_segment *seg = this->segment;
+	shm_record_t *r;
+	int i;
+
+	shm_reg_monitored(this, state->id, state->last_heard, state->timeout);
+	r = hashtable_search(this->local, state->id);
+	if (!r) {
+		return;
+	}
+	lock(seg);
+	if (r->users == 1) {
+		begin_write(r);
+		__atomic_store_n(&r->timeout, state->timeout, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->last_heard, state->last_heard, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->last_sent, state->last_sent, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->eta, state->eta, __ATOMIC_RELAXED);
+		r->last_ping = state->last_ping;
+		r->sum = 0;
+		r->size = 0;
+		r->start = 0;
+		i = state->window_size > SHM_WINDOW ? state->window_size - SHM_WINDOW : 0;
+		for (; i < state->window_size; i++) {
+			add_interarrival(r, state->interarrivals[i]);
+		}
+		end_write(r);
+	}
+	unlock(seg);
+}
+
+/* The segment is shared by every attached process. */
+void shm_memory_usage(shmfd_t *this, fd_memory_t *usage) {
+	long windows = this->segment->slots * SHM_WINDOW * sizeof(unsigned int);
+
+	memory_add_table(usage, this->local);
+	usage->records += this->size - windows;
+	usage->windows += windows;
+	memory_total(usage);
+}
+
+/* alpha is shared, so this reconfigures every attached process. */
+void shm_reconfigure(shmfd_t *this, struct hashtable *params_table) {
+	struct shm_segment *seg = this->segment;
+	long i;
+
+	lock(seg);
+	seg->alpha = parse_long(seg->alpha, hashtable_search(params_table, "alpha"));
+	for (i = 0; i < seg->slots; i++) {
+		shm_record_t *r = &seg->records[i];
+
+		if (r->state == SLOT_USED) {
+			begin_write(r);
+			update_timeout(seg, r);
+			end_write(r);
+		}
+	}
+	unlock(seg);
+}
+
+static void release_value(char *id, void *value, void *this) {
+	release_record(this, value);
+}
+
+/* Detaches from the segment, which the last process out removes. */
+void shm_destroy(shmfd_t *this) {
+	struct shm_segment *seg = this->segment;
+
+	fd_hashtable_foreach(this->local, release_value, this);
+	hashtable_destroy(this->local, 0);
+	lock(seg);
+	if (--seg->attached == 0) {
+		seg->unlinked = 1;
+		shm_unlink(this->name);
+	}
+	unlock(seg);
+	munmap(seg, this->size);
+	free(this->name);
+	free(this);
+}
+
+static void init_segment(struct shm_segment *seg, long slots, long capacity,
+		long alpha) {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&seg->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	seg->slots = slots;
+	seg->capacity = capacity;
+	seg->alpha = alpha;
+	__atomic_store_n(&seg->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+/* Maps the named segment, which the first process to open it creates.
+ * The others wait for it to be initialised. */
+static struct shm_segment* map_segment(char *name, long capacity, long alpha,
+		size_t *size) {
+	struct timespec poll = { 0, 1000000 };
+	struct shm_segment *seg;
+	struct stat st;
+	long slots = 2;
+	int fd, i;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) {
+		while (slots < 2 * capacity) {
+			slots *= 2;
+		}
+		*size = segment_size(slots);
+		seg = ftruncate(fd, *size) ? MAP_FAILED
+				: mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (seg == MAP_FAILED) {
+			shm_unlink(name);
+			return NULL;
+		}
+		init_segment(seg, slots, capacity, alpha);
+		return seg;
+	}
+	if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0600)) < 0) {
+		return NULL;
+	}
+	for (i = 0; i < ATTACH_POLLS; i++) {
+		if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(*seg)) {
+			seg = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (seg == MAP_FAILED) {
+				break;
+			}
+			if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SHM_MAGIC) {
+				*size = st.st_size;
+				close(fd);
+				return seg;
+			}
+			munmap(seg, st.st_size);
+		}
+		nanosleep(&poll, NULL);
+	}
+	close(fd);
+	return NULL;
+}
+
+shmfd_t* shmfd_init_params(char *name, long capacity, long alpha) {
+	shmfd_t *p_fd;
+	struct shm_segment *seg;
+	size_t size;
+
+	if (capacity < 1) {
+		return NULL;
+	}
+	/* a segment its last process is removing is replaced by a new one */
+	for (;;) {
+		seg = map_segment(name, capacity, alpha, &size);
+		if (!seg) {
+			return NULL;
+		}
+		lock(seg);
+		if (!seg->unlinked) {
+			seg->attached++;
+			unlock(seg);
+			break;
+		}
+		unlock(seg);
+		munmap(seg, size);
+	}
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)shm_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)shm_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)shm_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)shm_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)shm_set_to;
+	p_fd->fdetector.get_timeout = (void*)shm_get_to;
+	p_fd->fdetector.is_failed = (void*)shm_failed;
+	p_fd->fdetector.get_idle_time = (void*)shm_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)shm_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)shm_should_ping;
+	p_fd->fdetector.release_monitored = (void*)shm_release;
+	p_fd->fdetector.register_many = (void*)shm_reg_many;
+	p_fd->fdetector.release_many = (void*)shm_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)shm_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)shm_export_states;
+	p_fd->fdetector.import_state = (void*)shm_import_state;
+	p_fd->fdetector.memory_usage = (void*)shm_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)shm_reconfigure;
+	p_fd->fdetector.destroy = (void*)shm_destroy;
+
+	p_fd->segment = seg;
+	p_fd->size = size;
+	p_fd->name = strdup(name);
+	p_fd->pid = getpid();
+	p_fd->local = create_fd_hashtable();
+	return p_fd;
+}
+
+shmfd_t* shmfd_init(struct hashtable *params_table) {
+	char *name = hashtable_search(params_table, "shmname");
+
+	return shmfd_init_params(name ? name : DEF_NAME,
+			parse_long(DEF_CAPACITY, hashtable_search(params_table, "capacity")),
+			parse_long(DEF_ALPHA, hashtable_search(params_table, "alpha")));
+}
@@ -0,0 +1,56 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHM_FAILUREDETECTOR_H_
+#define SHM_FAILUREDETECTOR_H_
+
+#include <sys/types.h>
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+struct shm_segment;
+
+/* A detector kept in a named shared memory segment, so that the processes
+ * of a host monitoring the same servers share one heartbeat estimator per
+ * server and one ping stream. Every attached process can update and query
+ * it: updates take a process-shared robust mutex, queries read the records
+ * under a seqlock. A process is told to ping a server only while it holds
+ * the server's ping lease, see shm_should_ping.
+ *
+ * Timeouts are Chen's, the mean interarrival plus the margin alpha, which
+ * is shared by the attached processes. They must all pass times from the
+ * same clock. Ids are at most SHM_ID_LEN - 1 characters. */
+typedef struct {
+	fdetector_t fdetector;
+	struct shm_segment *segment;
+	size_t size; //bytes mapped
+	char *name;
+	pid_t pid;
+	struct hashtable *local; //ids this process registered, to their records
+} shmfd_t;
+
+#define SHM_ID_LEN 96
+
+shmfd_t* shmfd_init(struct hashtable *params_table);
+
+/* Attaches to the named segment, creating it for capacity monitoreds if it
+ * does not exist; alpha only applies to a created segment. Returns NULL if
+ * the segment cannot be created or mapped. */
+shmfd_t* shmfd_init_params(char *name, long capacity, long alpha);
+
+#endif /* SHM_FAILUREDETECTOR_H_ */
@@ -0,0 +1,353 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tick_failuredetector.h"
+#include "failuredetector.h"
+#include "failuredetector_factory.h"
+#include "fd_hashtable.h"
+#include "fd_memory.h"
+#include "../hashtable/hashtable.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEF_INNER "chen"
+#define MIN_CAPACITY 64
+
+#define FAILED 1
+#define PING_DUE 2
+
+typedef struct tick_entry {
+	char *id;
+	int slot;
+} tick_entry_t;
+
+static int grow(tickfd_t *this, int count) {
+	int capacity = this->capacity ? this->capacity : MIN_CAPACITY;
+	void *p;
+
+	if (count <= this->capacity) {
+		return 1;
+	}
+	while (capacity < count) {
+		capacity *= 2;
+	}
+#define GROW(array) \
+	if (!(p = realloc(this->array, capacity * sizeof(*this->array)))) { \
+		return 0; \
+	} \
+	this->array = p;
+	GROW(fail_at);
+	GROW(ping_at);
+	GROW(verdicts);
+	GROW(last_heard);
+	GROW(timeout);
+	GROW(slots);
+#undef GROW
+	this->capacity = capacity;
+	return 1;
+}
+
+static unsigned char verdict(tickfd_t *this, int slot) {
+	return (this->now > this->fail_at[slot] ? FAILED : 0)
+			| (this->now >= this->ping_at[slot] ? PING_DUE : 0);
+}
+
+/* Reads the monitored's deadlines back from the inner detector. */
+static void refresh(tickfd_t *this, tick_entry_t *e, long now) {
+	fdetector_t *inner = this->inner;
+	int slot = e->slot;
+
+	this->last_heard[slot] = now - inner->get_idle_time(inner, e->id, now);
+	this->timeout[slot] = inner->get_timeout(inner, e->id);
+	this->fail_at[slot] = this->last_heard[slot] + this->timeout[slot];
+	this->ping_at[slot] = now + inner->get_time_to_next_ping(inner, e->id, now);
+	this->verdicts[slot] = verdict(this, slot);
+
+	if (this->fail_at[slot] + 1 < this->next_deadline) {
+		this->next_deadline = this->fail_at[slot] + 1;
+	}
+	if (this->ping_at[slot] < this->next_deadline) {
+		this->next_deadline = this->ping_at[slot];
+	}
+}
+
+static tick_entry_t* add_entry(tickfd_t *this, char *id) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+
+	if (e) {
+		return e;
+	}
+	if (!grow(this, this->count + 1)) {
+		return NULL;
+	}
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		return NULL;
+	}
+	e->slot = this->count++;
+	this->slots[e->slot] = e;
+	e->id = fd_hashtable_insert(this->entries, id, e);
+	return e;
+}
+
+/* Moves the last slot into the released one to keep the arrays dense. */
+static void remove_entry(tickfd_t *this, char *id) {
+	tick_entry_t *e = hashtable_remove(this->entries, id);
+	int last = this->count - 1;
+
+	if (!e) {
+		return;
+	}
+	if (e->slot != last) {
+		this->fail_at[e->slot] = this->fail_at[last];
+		this->ping_at[e->slot] = this->ping_at[last];
+		this->verdicts[e->slot] = this->verdicts[last];
+		this->last_heard[e->slot] = this->last_heard[last];
+		this->timeout[e->slot] = this->timeout[last];
+		this->slots[e->slot] = this->slots[last];
+		this->slots[e->slot]->slot = e->slot;
+	}
+	this->count--;
+	free(e);
+}
+
+void tick_tick(tickfd_t *this, long now) {
+	long next = LONG_MAX;
+	int i;
+
+	this->now = now;
+	if (now < this->next_deadline) {
+		return;
+	}
+	for (i = 0; i < this->count; i++) {
+		long fail_at = this->fail_at[i];
+		long ping_at = this->ping_at[i];
+
+		this->verdicts[i] = (now > fail_at ? FAILED : 0)
+				| (now >= ping_at ? PING_DUE : 0);
+		if (fail_at >= now && fail_at + 1 < next) {
+			next = fail_at + 1;
+		}
+		if (ping_at > now && ping_at < next) {
+			next = ping_at;
+		}
+	}
+	this->next_deadline = next;
+}
+
+void fd_tick(fdetector_t *fd, long now) {
+	if (fd->tick) {
+		fd->tick(fd, now);
+	}
+}
+
+/* Adds the entry of an id the inner detector just registered. Out of
+ * memory, the id is released from the inner detector again, so that it
+ * is registered in both or in neither. */
+static void track(tickfd_t *this, char *id, long now) {
+	tick_entry_t *e = add_entry(this, id);
+
+	if (!e) {
+		this->inner->release_monitored(this->inner, id);
+		return;
+	}
+	refresh(this, e, now);
+}
+
+void tick_reg_monitored(tickfd_t *this, char *id, long now, long timeout) {
+	this->inner->register_monitored(this->inner, id, now, timeout);
+	track(this, id, now);
+}
+
+void tick_reg_in_cohort(tickfd_t *this, char *id, char *group, long now,
+		long timeout) {
+	this->inner->register_in_cohort(this->inner, id, group, now, timeout);
+	track(this, id, now);
+}
+
+void tick_reg_many(tickfd_t *this, char **ids, int count, long now,
+		long timeout) {
+	int i;
+
+	this->inner->register_many(this->inner, ids, count, now, timeout);
+	hashtable_reserve(this->entries, hashtable_count(this->entries) + count);
+	if (!grow(this, this->count + count)) {
+		for (i = 0; i < count; i++) {
+			if (!hashtable_search(this->entries, ids[i])) {
+				this->inner->release_monitored(this->inner, ids[i]);
+			}
+		}
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		track(this, ids[i], now);
+	}
+}
+
+void tick_release(tickfd_t *this, char *id) {
+	remove_entry(this, id);
+	this->inner->release_monitored(this->inner, id);
+}
+
+void tick_release_many(tickfd_t *this, char **ids, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		remove_entry(this, ids[i]);
+	}
+	this->inner->release_many(this->inner, ids, count);
+}
+
+void tick_msg_rcv(tickfd_t *this, char *id, long now, int type) {
+	this->inner->message_received(this->inner, id, now, type);
+	refresh(this, hashtable_search(this->entries, id), now);
+}
+
+void tick_msg_sent(tickfd_t *this, char *id, long now, int type) {
+	this->inner->message_sent(this->inner, id, now, type);
+	refresh(this, hashtable_search(this->entries, id), now);
+}
+
+void tick_set_to(tickfd_t *this, char *id, long timeout) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+
+	this->inner->set_timeout(this->inner, id, timeout);
+	refresh(this, e, this->now);
+}
+
+void tick_set_ping_interval(tickfd_t *this, char *id, long interval) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+
+	this->inner->set_ping_interval(this->inner, id, interval);
+	refresh(this, e, this->now);
+}
+
+int tick_failed(tickfd_t *this, char *id, long now) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+	return this->verdicts[e->slot] & FAILED;
+}
+
+int tick_should_ping(tickfd_t *this, char *id, long now) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+	return (this->verdicts[e->slot] & PING_DUE) != 0;
+}
+
+long tick_get_idle(tickfd_t *this, char *id, long now) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+	return now - this->last_heard[e->slot];
+}
+
+long tick_time_next_ping(tickfd_t *this, char *id, long now) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+	return this->ping_at[e->slot] - now;
+}
+
+long tick_get_to(tickfd_t *this, char *id) {
+	tick_entry_t *e = hashtable_search(this->entries, id);
+	return this->timeout[e->slot];
+}
+
+void tick_export_states(tickfd_t *this, fd_state_visitor_t *visitor) {
+	this->inner->export_states(this->inner, visitor);
+}
+
+void tick_import_state(tickfd_t *this, fd_state_t *state) {
+	this->inner->import_state(this->inner, state);
+	track(this, state->id, state->last_heard);
+}
+
+/* The inner detector's usage, plus the entries and the deadline arrays. */
+void tick_memory_usage(tickfd_t *this, fd_memory_t *usage) {
+	fd_memory_usage(this->inner, usage);
+	memory_add_table(usage, this->entries);
+	usage->records += this->count * sizeof(tick_entry_t)
+			+ this->capacity * (sizeof(*this->fail_at) + sizeof(*this->ping_at)
+					+ sizeof(*this->verdicts) + sizeof(*this->last_heard)
+					+ sizeof(*this->timeout) + sizeof(*this->slots));
+	memory_total(usage);
+}
+
+/* Reconfigures the inner detector and reads every deadline back. */
+void tick_reconfigure(tickfd_t *this, struct hashtable *params_table) {
+	int i;
+
+	fd_reconfigure(this->inner, params_table);
+	this->next_deadline = LONG_MAX;
+	for (i = 0; i < this->count; i++) {
+		refresh(this, this->slots[i], this->now);
+	}
+}
+
+void tick_destroy(tickfd_t *this) {
+	fd_destroy(this->inner);
+	hashtable_destroy(this->entries, 1);
+	free(this->fail_at);
+	free(this->ping_at);
+	free(this->verdicts);
+	free(this->last_heard);
+	free(this->timeout);
+	free(this->slots);
+	free(this);
+}
+
+tickfd_t* tickfd_init_params(char *inner_name, struct hashtable *params_table) {
+	tickfd_t *p_fd;
+	fdetector_t *inner;
+
+	if (strcmp(inner_name, "tick") == 0) {
+		return NULL;
+	}
+	inner = create_failure_detector(inner_name, params_table);
+	if (!inner) {
+		return NULL;
+	}
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)tick_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)tick_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)tick_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)tick_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)tick_set_to;
+	p_fd->fdetector.get_timeout = (void*)tick_get_to;
+	p_fd->fdetector.is_failed = (void*)tick_failed;
+	p_fd->fdetector.get_idle_time = (void*)tick_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)tick_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)tick_should_ping;
+	p_fd->fdetector.release_monitored = (void*)tick_release;
+	p_fd->fdetector.register_many = (void*)tick_reg_many;
+	p_fd->fdetector.release_many = (void*)tick_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)tick_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)tick_export_states;
+	p_fd->fdetector.import_state = (void*)tick_import_state;
+	p_fd->fdetector.memory_usage = (void*)tick_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)tick_reconfigure;
+	p_fd->fdetector.destroy = (void*)tick_destroy;
+	p_fd->fdetector.tick = (void*)tick_tick;
+
+	p_fd->inner = inner;
+	p_fd->entries = create_fd_hashtable();
+	p_fd->next_deadline = LONG_MAX;
+	return p_fd;
+}
+
+tickfd_t* tickfd_init(struct hashtable *params_table) {
+	char *inner = hashtable_search(params_table, "inner");
+	return tickfd_init_params(inner ? inner : DEF_INNER, params_table);
+}
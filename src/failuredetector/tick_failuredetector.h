@@ -0,0 +1,54 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TICK_FAILUREDETECTOR_H_
+#define TICK_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+/* Wraps an inner detector for clients that run a periodic tick. Verdicts
+ * are evaluated for every monitored at each fd_tick, in one pass over
+ * contiguous deadlines, and is_failed and should_ping return the verdict
+ * of the last tick. Updates between ticks refresh the monitored's
+ * deadlines and verdict at once. */
+typedef struct {
+	fdetector_t fdetector;
+	fdetector_t *inner;
+	struct hashtable *entries;
+	long now; //time of the last tick
+	long next_deadline; //earliest time a verdict can change
+	int count;
+	int capacity;
+
+	/* per monitored, indexed by the entry's slot */
+	long *fail_at;
+	long *ping_at;
+	unsigned char *verdicts;
+	long *last_heard;
+	long *timeout;
+	struct tick_entry **slots;
+} tickfd_t;
+
+tickfd_t* tickfd_init(struct hashtable *params_table);
+
+/* Advances fd's verdicts to now. Detectors without a tick mode answer
+ * every query live and ignore it. */
+void fd_tick(fdetector_t *fd, long now);
+
+#endif /* TICK_FAILUREDETECTOR_H_ */
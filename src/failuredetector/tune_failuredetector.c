@@ -0,0 +1,361 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tune_failuredetector.h"
+#include "failuredetector.h"
+#include "failuredetector_factory.h"
+#include "fd_hashtable.h"
+#include "fd_memory.h"
+#include "fd_opt_parser.h"
+#include "tick_failuredetector.h"
+#include "rtt_failuredetector.h"
+#include "../hashtable/hashtable.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEF_INNER "chen"
+#define DEF_MISTAKE_RATE 1.
+#define DEF_MIN_SCALE 0.5
+#define DEF_MAX_SCALE 4.
+#define HOUR 3600000.
+/* ratio between the live scale and its shadows */
+#define TUNE_STEP 1.25
+/* mistakes expected at the target before the tuner moves, enough for
+ * the counts to tell the scales apart */
+#define EPOCH_MISTAKES 4
+
+enum { LOWER, LIVE, UPPER };
+
+typedef struct {
+	fd_tuner_t own;
+	fd_tuner_t *tuner; //own, or the cohort's
+} tune_entry_t;
+
+static void init_tuner(fd_tuner_t *t) {
+	memset(t, 0, sizeof(*t));
+	t->scale = 1;
+}
+
+static double bounded_scale(tunefd_t *this, fd_tuner_t *t, double scale) {
+	if (this->max_detection > 0 && t->arrivals
+			&& scale * t->timeouts / t->arrivals > this->max_detection) {
+		scale = this->max_detection * t->arrivals / t->timeouts;
+	}
+	return fmin(fmax(scale, this->min_scale), this->max_scale);
+}
+
+/* Moves the live scale once the counts are conclusive: as soon as the
+ * live scale mistook twice as often as an epoch allows, or else once an
+ * epoch's worth of monitored time has been seen. */
+static void steer(tunefd_t *this, fd_tuner_t *t) {
+	double expected = this->mistake_rate * t->exposure / HOUR;
+	double scale = t->scale;
+
+	if (t->mistakes[LIVE] <= 2 * EPOCH_MISTAKES && expected < EPOCH_MISTAKES) {
+		return;
+	}
+	if (t->mistakes[LIVE] > expected) {
+		scale *= t->mistakes[UPPER] > expected ? TUNE_STEP * TUNE_STEP : TUNE_STEP;
+	} else if (t->mistakes[LOWER] <= expected) {
+		scale /= TUNE_STEP;
+	}
+	t->scale = bounded_scale(this, t, scale);
+	memset(t->mistakes, 0, sizeof(t->mistakes));
+	t->exposure = 0;
+	t->timeouts = 0;
+	t->arrivals = 0;
+}
+
+/* Scores an arrival after idle ms against each scale of the timeout that
+ * was in force. */
+static void observe(tunefd_t *this, fd_tuner_t *t, long idle, long timeout) {
+	static const double factors[] = { 1 / TUNE_STEP, 1, TUNE_STEP };
+	int i;
+
+	for (i = LOWER; i <= UPPER; i++) {
+		if (idle > (long)round(t->scale * factors[i] * timeout)) {
+			t->mistakes[i]++;
+		}
+	}
+	t->exposure += idle;
+	t->timeouts += timeout;
+	t->arrivals++;
+	if (this->mistake_rate > 0) {
+		steer(this, t);
+	}
+}
+
+static tune_entry_t* add_entry(tunefd_t *this, char *id) {
+	tune_entry_t *e = hashtable_search(this->entries, id);
+
+	if (!e) {
+		e = malloc(sizeof(*e));
+		if (!e) {
+			return NULL;
+		}
+		init_tuner(&e->own);
+		e->tuner = &e->own;
+		fd_hashtable_insert(this->entries, id, e);
+	}
+	return e;
+}
+
+static fd_tuner_t* group_tuner(tunefd_t *this, char *group) {
+	fd_tuner_t *t = hashtable_search(this->groups, group);
+
+	if (!t) {
+		t = malloc(sizeof(*t));
+		if (!t) {
+			return NULL;
+		}
+		init_tuner(t);
+		fd_hashtable_insert(this->groups, group, t);
+	}
+	return t;
+}
+
+static long scaled_timeout(tunefd_t *this, char *id, long timeout) {
+	tune_entry_t *e = hashtable_search(this->entries, id);
+	return e ? (long)round(e->tuner->scale * timeout) : timeout;
+}
+
+/* Adds the entry of an id the inner detector just registered. Out of
+ * memory, the id is released from the inner detector again, so that it
+ * is registered in both or in neither. */
+static tune_entry_t* track(tunefd_t *this, char *id) {
+	tune_entry_t *e = add_entry(this, id);
+
+	if (!e) {
+		this->inner->release_monitored(this->inner, id);
+	}
+	return e;
+}
+
+void tune_reg_monitored(tunefd_t *this, char *id, long now, long timeout) {
+	this->inner->register_monitored(this->inner, id, now, timeout);
+	track(this, id);
+}
+
+void tune_reg_in_cohort(tunefd_t *this, char *id, char *group, long now,
+		long timeout) {
+	tune_entry_t *e;
+	fd_tuner_t *t;
+
+	this->inner->register_in_cohort(this->inner, id, group, now, timeout);
+	if (!(e = track(this, id))) {
+		return;
+	}
+	if (!(t = group_tuner(this, group))) {
+		free(hashtable_remove(this->entries, id));
+		this->inner->release_monitored(this->inner, id);
+		return;
+	}
+	e->tuner = t;
+}
+
+void tune_reg_many(tunefd_t *this, char **ids, int count, long now,
+		long timeout) {
+	int i;
+
+	this->inner->register_many(this->inner, ids, count, now, timeout);
+	hashtable_reserve(this->entries, hashtable_count(this->entries) + count);
+	for (i = 0; i < count; i++) {
+		track(this, ids[i]);
+	}
+}
+
+void tune_release(tunefd_t *this, char *id) {
+	free(hashtable_remove(this->entries, id));
+	this->inner->release_monitored(this->inner, id);
+}
+
+void tune_release_many(tunefd_t *this, char **ids, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		free(hashtable_remove(this->entries, ids[i]));
+	}
+	this->inner->release_many(this->inner, ids, count);
+}
+
+/* The idle time and the timeout are read before the message resets them. */
+void tune_msg_rcv(tunefd_t *this, char *id, long now, int type) {
+	tune_entry_t *e = hashtable_search(this->entries, id);
+	long idle = this->inner->get_idle_time(this->inner, id, now);
+	long timeout = this->inner->get_timeout(this->inner, id);
+
+	this->inner->message_received(this->inner, id, now, type);
+	if (e && idle > 0 && timeout > 0) {
+		observe(this, e->tuner, idle, timeout);
+	}
+}
+
+void tune_msg_sent(tunefd_t *this, char *id, long now, int type) {
+	this->inner->message_sent(this->inner, id, now, type);
+}
+
+/* The inner detector's verdict, read as of when its idle time reaches
+ * the scaled timeout, so that whatever else it decides by (held, cached
+ * or remembered suspicions, unknown ids) still applies. */
+int tune_failed(tunefd_t *this, char *id, long now) {
+	long timeout = this->inner->get_timeout(this->inner, id);
+
+	return this->inner->is_failed(this->inner, id,
+			now + timeout - scaled_timeout(this, id, timeout));
+}
+
+int tune_should_ping(tunefd_t *this, char *id, long now) {
+	return this->inner->should_ping(this->inner, id, now);
+}
+
+/* Sets the inner timeout that scales to the given one. */
+void tune_set_to(tunefd_t *this, char *id, long timeout) {
+	tune_entry_t *e = hashtable_search(this->entries, id);
+
+	this->inner->set_timeout(this->inner, id,
+			e ? (long)round(timeout / e->tuner->scale) : timeout);
+}
+
+long tune_get_to(tunefd_t *this, char *id) {
+	return scaled_timeout(this, id, this->inner->get_timeout(this->inner, id));
+}
+
+void tune_set_ping_interval(tunefd_t *this, char *id, long interval) {
+	this->inner->set_ping_interval(this->inner, id, interval);
+}
+
+long tune_get_idle(tunefd_t *this, char *id, long now) {
+	return this->inner->get_idle_time(this->inner, id, now);
+}
+
+long tune_time_next_ping(tunefd_t *this, char *id, long now) {
+	return this->inner->get_time_to_next_ping(this->inner, id, now);
+}
+
+long tune_get_rtt(tunefd_t *this, char *id) {
+	return fd_get_rtt(this->inner, id);
+}
+
+void tune_tick(tunefd_t *this, long now) {
+	fd_tick(this->inner, now);
+}
+
+/* The scales are not exported; imported monitoreds start untuned. */
+void tune_export_states(tunefd_t *this, fd_state_visitor_t *visitor) {
+	this->inner->export_states(this->inner, visitor);
+}
+
+void tune_import_state(tunefd_t *this, fd_state_t *state) {
+	this->inner->import_state(this->inner, state);
+	track(this, state->id);
+}
+
+void tune_memory_usage(tunefd_t *this, fd_memory_t *usage) {
+	fd_memory_usage(this->inner, usage);
+	memory_add_table(usage, this->entries);
+	memory_add_table(usage, this->groups);
+	usage->records += hashtable_count(this->entries) * sizeof(tune_entry_t)
+			+ hashtable_count(this->groups) * sizeof(fd_tuner_t);
+	memory_total(usage);
+}
+
+static void parse_tuning(tunefd_t *this, struct hashtable *params_table) {
+	this->mistake_rate = parse_double(this->mistake_rate,
+			hashtable_search(params_table, "mistakerate"));
+	this->min_scale = parse_double(this->min_scale,
+			hashtable_search(params_table, "minscale"));
+	this->max_scale = parse_double(this->max_scale,
+			hashtable_search(params_table, "maxscale"));
+	this->max_detection = parse_long(this->max_detection,
+			hashtable_search(params_table, "maxdetection"));
+	if (this->min_scale <= 0) {
+		this->min_scale = DEF_MIN_SCALE;
+	}
+	if (this->max_scale < this->min_scale) {
+		this->max_scale = this->min_scale;
+	}
+}
+
+/* New bounds apply from each tuner's next move. */
+void tune_reconfigure(tunefd_t *this, struct hashtable *params_table) {
+	fd_reconfigure(this->inner, params_table);
+	parse_tuning(this, params_table);
+}
+
+void tune_destroy(tunefd_t *this) {
+	fd_destroy(this->inner);
+	hashtable_destroy(this->entries, 1);
+	hashtable_destroy(this->groups, 1);
+	free(this);
+}
+
+tunefd_t* tunefd_init_params(char *inner_name, struct hashtable *params_table) {
+	tunefd_t *p_fd;
+	fdetector_t *inner;
+
+	if (strcmp(inner_name, "tune") == 0) {
+		return NULL;
+	}
+	inner = create_failure_detector(inner_name, params_table);
+	if (!inner) {
+		return NULL;
+	}
+
+	p_fd = calloc(1, sizeof(*p_fd));
+	p_fd->fdetector.message_received = (void*)tune_msg_rcv;
+	p_fd->fdetector.message_sent = (void*)tune_msg_sent;
+	p_fd->fdetector.register_monitored = (void*)tune_reg_monitored;
+	p_fd->fdetector.register_in_cohort = (void*)tune_reg_in_cohort;
+	p_fd->fdetector.set_timeout = (void*)tune_set_to;
+	p_fd->fdetector.get_timeout = (void*)tune_get_to;
+	p_fd->fdetector.is_failed = (void*)tune_failed;
+	p_fd->fdetector.get_idle_time = (void*)tune_get_idle;
+	p_fd->fdetector.get_time_to_next_ping = (void*)tune_time_next_ping;
+	p_fd->fdetector.should_ping = (void*)tune_should_ping;
+	p_fd->fdetector.release_monitored = (void*)tune_release;
+	p_fd->fdetector.register_many = (void*)tune_reg_many;
+	p_fd->fdetector.release_many = (void*)tune_release_many;
+	p_fd->fdetector.set_ping_interval = (void*)tune_set_ping_interval;
+	p_fd->fdetector.export_states = (void*)tune_export_states;
+	p_fd->fdetector.import_state = (void*)tune_import_state;
+	p_fd->fdetector.memory_usage = (void*)tune_memory_usage;
+	p_fd->fdetector.reconfigure = (void*)tune_reconfigure;
+	p_fd->fdetector.destroy = (void*)tune_destroy;
+	if (inner->get_rtt) {
+		p_fd->fdetector.get_rtt = (void*)tune_get_rtt;
+	}
+	if (inner->tick) {
+		p_fd->fdetector.tick = (void*)tune_tick;
+	}
+
+	p_fd->inner = inner;
+	p_fd->entries = create_fd_hashtable();
+	p_fd->groups = create_fd_hashtable();
+	p_fd->mistake_rate = DEF_MISTAKE_RATE;
+	p_fd->min_scale = DEF_MIN_SCALE;
+	p_fd->max_scale = DEF_MAX_SCALE;
+	parse_tuning(p_fd, params_table);
+	return p_fd;
+}
+
+tunefd_t* tunefd_init(struct hashtable *params_table) {
+	char *inner = hashtable_search(params_table, "inner");
+	return tunefd_init_params(inner ? inner : DEF_INNER, params_table);
+}
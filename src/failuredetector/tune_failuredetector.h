@@ -0,0 +1,60 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TUNE_FAILUREDETECTOR_H_
+#define TUNE_FAILUREDETECTOR_H_
+
+#include "../hashtable/hashtable.h"
+#include "failuredetector.h"
+
+/* Mistake counts of the live timeout scale and of the shadow scales a step
+ * below and above it, since the tuner last moved. The scales are nested,
+ * so a lower one mistakes at least every time a higher one does. */
+typedef struct {
+	double scale;
+	long mistakes[3]; //lower, live, upper
+	double exposure; //ms of monitored time observed
+	double timeouts; //sum of the inner timeouts, at each arrival
+	long arrivals;
+} fd_tuner_t;
+
+/* Wraps an inner detector, scaling its timeouts per monitored, or per
+ * cohort for monitoreds registered in one, toward a target rate of false
+ * suspicions. A message arriving after the monitored had been idle for
+ * longer than a scaled timeout is a mistake of that scale, so each
+ * arrival scores the live scale and its two shadows at once. Once enough
+ * monitored time has been seen to expect a few mistakes at the target,
+ * the live scale steps down if the lower shadow met the target, or up
+ * if the live one missed it, within the maximum detection time. */
+typedef struct {
+	fdetector_t fdetector;
+	fdetector_t *inner;
+	struct hashtable *entries;
+	struct hashtable *groups; //cohort tuners, kept until destroyed
+
+	double mistake_rate; //target per monitored hour
+	double min_scale;
+	double max_scale;
+	long max_detection; //bound on a scaled timeout, 0 for none
+} tunefd_t;
+
+tunefd_t* tunefd_init(struct hashtable *params_table);
+
+tunefd_t* tunefd_init_params(char *inner_name, struct hashtable *params_table);
+
+#endif /* TUNE_FAILUREDETECTOR_H_ */
@@ -125,6 +125,41 @@ hashtable_expand(struct hashtable *h)
     return -1;
 }
 
+/*****************************************************************************/
+int
+hashtable_reserve(struct hashtable *h, unsigned int count)
+{
+    /* Grow the table, in a single rehash, so that count entries fit
+     * without further expansion */
+    struct entry **newtable;
+    struct entry *e;
+    unsigned int newsize, pindex, i, index;
+    if (count <= h->loadlimit) return -1;
+    if (h->primeindex == (prime_table_length - 1)) return 0;
+    for (pindex = h->primeindex + 1; pindex < prime_table_length - 1; pindex++) {
+        if ((unsigned int) ceil(primes[pindex] * max_load_factor) >= count) break;
+    }
+    newsize = primes[pindex];
+
+    newtable = (struct entry **)malloc(sizeof(struct entry*) * newsize);
+    if (NULL == newtable) return 0; /*oom*/
+    memset(newtable, 0, newsize * sizeof(struct entry *));
+    for (i = 0; i < h->tablelength; i++) {
+        while (NULL != (e = h->table[i])) {
+            h->table[i] = e->next;
+            index = indexFor(newsize,e->h);
+            e->next = newtable[index];
+            newtable[index] = e;
+        }
+    }
+    free(h->table);
+    h->table       = newtable;
+    h->tablelength = newsize;
+    h->primeindex  = pindex;
+    h->loadlimit   = (unsigned int) ceil(newsize * max_load_factor);
+    return -1;
+}
+
 /*****************************************************************************/
 unsigned int
 hashtable_count(struct hashtable *h)
@@ -132,6 +167,15 @@ hashtable_count(struct hashtable *h)
     return h->entrycount;
 }
 
+/*****************************************************************************/
+unsigned long
+hashtable_memory(struct hashtable *h)
+{
+    return sizeof(struct hashtable)
+        + (unsigned long)h->tablelength * sizeof(struct entry *)
+        + (unsigned long)h->entrycount * sizeof(struct entry);
+}
+
 /*****************************************************************************/
 int
 hashtable_insert(struct hashtable *h, void *k, void *v)
@@ -145,6 +145,20 @@ valuetype * fnname (struct hashtable *h, keytype *k) \
 }
 
 
+/*****************************************************************************
+ * hashtable_reserve
+   
+ * @name        hashtable_reserve
+ * @param   h   the hashtable to grow
+ * @param   count   the number of entries the table should hold
+ * @return      non-zero if the table can hold count entries without
+ *              expanding again, zero if the larger table could not be
+ *              allocated
+ */
+int
+hashtable_reserve(struct hashtable *h, unsigned int count);
+
+
 /*****************************************************************************
  * hashtable_count
    
@@ -156,6 +170,18 @@ unsigned int
 hashtable_count(struct hashtable *h);
 
 
+/*****************************************************************************
+ * hashtable_memory
+   
+ * @name        hashtable_memory
+ * @param   h   the hashtable
+ * @return      the bytes held by the table and its entries, excluding the
+ *              keys and values themselves
+ */
+unsigned long
+hashtable_memory(struct hashtable *h);
+
+
 /*****************************************************************************
  * hashtable_destroy
    